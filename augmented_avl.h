@@ -0,0 +1,895 @@
+#ifndef AUGMENTED_AVL_H
+#define AUGMENTED_AVL_H
+
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "avlbst.h"
+
+/**
+ * Monoids for AugmentedAVLTree. A monoid names the type of its
+ * aggregate (value_type), maps one tree value to an aggregate (lift),
+ * and combines two adjacent aggregates with an associative operation
+ * whose neutral element is identity(). combine(a, b) always has a
+ * covering keys before b, so the operation need not be commutative.
+ */
+template <typename T>
+struct SumMonoid
+{
+    typedef T value_type;
+    value_type identity() const { return T(); }
+    value_type lift(const T& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return a + b; }
+};
+
+template <typename T>
+struct MinMonoid
+{
+    typedef T value_type;
+    value_type identity() const { return std::numeric_limits<T>::max(); }
+    value_type lift(const T& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return b < a ? b : a; }
+};
+
+template <typename T>
+struct MaxMonoid
+{
+    typedef T value_type;
+    value_type identity() const { return std::numeric_limits<T>::lowest(); }
+    value_type lift(const T& value) const { return value; }
+    value_type combine(const value_type& a, const value_type& b) const { return a < b ? b : a; }
+};
+
+/**
+* An AVLNode that also caches the aggregate of every value in its subtree.
+*/
+template <typename Key, typename Value, typename Aggregate>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugmentedAVLNode(Key&& key, Value&& value, AugmentedAVLNode<Key, Value, Aggregate>* parent);
+
+    const Aggregate& getAggregate() const;
+    void setAggregate(Aggregate aggregate);
+
+    AugmentedAVLNode<Key, Value, Aggregate>* getParent() const;
+    AugmentedAVLNode<Key, Value, Aggregate>* getLeft() const;
+    AugmentedAVLNode<Key, Value, Aggregate>* getRight() const;
+
+protected:
+    Aggregate aggregate_;
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the AugmentedAVLNode class.
+  ---------------------------------------------------------
+*/
+
+/**
+* Moves the key and value in. The aggregate is set by the tree once the
+* node is linked, since only the tree knows its monoid.
+*/
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>::AugmentedAVLNode(Key&& key, Value&& value,
+    AugmentedAVLNode<Key, Value, Aggregate>* parent) :
+    AVLNode<Key, Value>(std::move(key), std::move(value), parent), aggregate_()
+{
+
+}
+
+/**
+* A getter for the aggregate of the subtree rooted at this node.
+*/
+template<class Key, class Value, class Aggregate>
+const Aggregate& AugmentedAVLNode<Key, Value, Aggregate>::getAggregate() const
+{
+    return aggregate_;
+}
+
+/**
+* A setter for the aggregate of the subtree rooted at this node.
+*/
+template<class Key, class Value, class Aggregate>
+void AugmentedAVLNode<Key, Value, Aggregate>::setAggregate(Aggregate aggregate)
+{
+    aggregate_ = std::move(aggregate);
+}
+
+/**
+* Hides AVLNode::getParent to return the augmented node type; see AVLNode.
+*/
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>* AugmentedAVLNode<Key, Value, Aggregate>::getParent() const
+{
+    return static_cast<AugmentedAVLNode<Key, Value, Aggregate>*>(this->parent_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>* AugmentedAVLNode<Key, Value, Aggregate>::getLeft() const
+{
+    return static_cast<AugmentedAVLNode<Key, Value, Aggregate>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>* AugmentedAVLNode<Key, Value, Aggregate>::getRight() const
+{
+    return static_cast<AugmentedAVLNode<Key, Value, Aggregate>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the AugmentedAVLNode class.
+  -------------------------------------------------------
+*/
+
+/**
+ * An AVLTree that caches, in every node, the Monoid aggregate of the
+ * values in its subtree, so the aggregate of any key range is found in
+ * O(log n) by rangeAggregate instead of visiting each key in it. The
+ * aggregates are recomputed bottom-up wherever the base tree restructures
+ * (rotations, retracing, join and split) and wherever insert or
+ * insert_or_assign overwrite a value.
+ *
+ * Values can only be changed through those calls. operator[] and the
+ * iterators hand out const values, since a write through them would
+ * bypass the tree and leave stale aggregates; to change a value, call
+ * insert_or_assign. The set operations, split and join only accept other
+ * AugmentedAVLTrees of the same type, whose nodes carry the same aggregate.
+ */
+template <class Key, class Value, class Monoid, class Compare = std::less<Key> >
+class AugmentedAVLTree : public AVLTree<Key, Value, Compare>
+{
+protected:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator BaseIterator;
+
+public:
+    typedef typename Monoid::value_type Aggregate;
+
+    /**
+    * An iterator over the pairs in key order, like BinarySearchTree's,
+    * except that the pairs it hands out are const.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator& operator--();
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Monoid, Compare>;
+        explicit iterator(const BaseIterator& it);
+        BaseIterator it_;
+    };
+
+    /**
+    * The keys in [lo, hi), as returned by range(); see BinarySearchTree::Range.
+    */
+    class Range
+    {
+    public:
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Monoid, Compare>;
+        Range(iterator first, iterator last);
+        iterator first_;
+        iterator last_;
+    };
+
+    AugmentedAVLTree();
+    explicit AugmentedAVLTree(const Monoid& monoid, const Compare& comp = Compare());
+    template<typename InputIterator>
+    AugmentedAVLTree(InputIterator first, InputIterator last, const Monoid& monoid = Monoid(),
+        const Compare& comp = Compare());
+    virtual ~AugmentedAVLTree();
+
+    Aggregate aggregate() const;
+    Aggregate rangeAggregate(const Key& lo, const Key& hi) const;
+
+    void split(const Key& key, AugmentedAVLTree<Key, Value, Monoid, Compare>& left,
+        AugmentedAVLTree<Key, Value, Monoid, Compare>& right);
+    void join(AugmentedAVLTree<Key, Value, Monoid, Compare>& left, const std::pair<const Key, Value>& pivot,
+        AugmentedAVLTree<Key, Value, Monoid, Compare>& right);
+    void unionWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other);
+    void intersectWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other);
+    void differenceWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other);
+
+    // The lookups and insertions of the base trees, returning iterators
+    // that only read; these hide the base versions
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator find(const Key& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key);
+    Value const & operator[](const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value const & operator[](const K& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    iterator select(std::size_t k) const;
+    iterator erase(iterator pos);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj);
+
+protected:
+    typedef AugmentedAVLNode<Key, Value, Aggregate> NodeType;
+
+    static std::pair<iterator, bool> wrap(const std::pair<BaseIterator, bool>& result);
+
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual bool trivialNodes() const;
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void refresh(AVLNode<Key, Value>* node);
+    virtual void updatePath(AVLNode<Key, Value>* node, int64_t delta);
+    virtual void valueChanged(Node<Key, Value>* node);
+
+    Aggregate aggregateOf(NodeType* node) const;
+    Aggregate suffixAggregate(NodeType* node, const Key& lo) const;
+    Aggregate prefixAggregate(NodeType* node, const Key& hi) const;
+
+    Monoid monoid_;
+};
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the AugmentedAVLTree::iterator class.
+  ---------------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::iterator() :
+    it_()
+{
+
+}
+
+/**
+* Wraps an iterator of the base tree.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::iterator(const BaseIterator& it) :
+    it_(it)
+{
+
+}
+
+/**
+* Provides read-only access to the item.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+const std::pair<const Key, Value>& AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator*() const
+{
+    return *it_;
+}
+
+/**
+* Provides the address of the item, read-only.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+const std::pair<const Key, Value>* AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+/**
+* Checks if both iterators refer to the same position.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+bool AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+/**
+* Checks if the iterators refer to different positions.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+bool AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+/**
+* Advances to the next key in order.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator&
+AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+/**
+* Moves back to the previous key in order; see BinarySearchTree::iterator.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator&
+AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+/*
+  -------------------------------------------------------------
+  End implementations for the AugmentedAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------------
+  Begin implementations for the AugmentedAVLTree::Range class.
+  ------------------------------------------------------------
+*/
+
+/**
+* A range from first up to (but not including) last.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::Range::Range(iterator first, iterator last) :
+    first_(first),
+    last_(last)
+{
+
+}
+
+/**
+* Returns an iterator to the first key in the range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::Range::begin() const
+{
+    return first_;
+}
+
+/**
+* Returns an iterator just past the last key in the range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::Range::end() const
+{
+    return last_;
+}
+
+/**
+* Returns true if no key falls in the range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+bool AugmentedAVLTree<Key, Value, Monoid, Compare>::Range::empty() const
+{
+    return first_ == last_;
+}
+
+/*
+  ----------------------------------------------------------
+  End implementations for the AugmentedAVLTree::Range class.
+  ----------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the AugmentedAVLTree class.
+  ---------------------------------------------------------
+*/
+
+/**
+* Constructor for an empty tree with a default constructed monoid.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree() :
+    AVLTree<Key, Value, Compare>(sizeof(NodeType), Compare()),
+    monoid_()
+{
+
+}
+
+/**
+* Constructor for an empty tree aggregating with monoid, ordered by comp.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree(const Monoid& monoid, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(sizeof(NodeType), comp),
+    monoid_(monoid)
+{
+
+}
+
+/**
+* Range constructor; builds a balanced tree from [first, last) as
+* AVLTree's does, computing the aggregates on the way back up.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename InputIterator>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree(InputIterator first, InputIterator last,
+    const Monoid& monoid, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(sizeof(NodeType), comp),
+    monoid_(monoid)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Destructor; clears here so that destroyNode still runs ~AugmentedAVLNode.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::~AugmentedAVLTree()
+{
+    this->clear();
+}
+
+/**
+* Returns the aggregate of every value in the tree in O(1).
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::aggregate() const
+{
+    return aggregateOf(static_cast<NodeType*>(this->root_));
+}
+
+/**
+* Returns the aggregate of the values whose keys lie in [lo, hi), in key
+* order, or identity() if there are none. The search descends to the
+* highest node inside the range, and from there one path to each end of
+* the range, adding whole cached subtrees on the way: O(log n).
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::rangeAggregate(const Key& lo, const Key& hi) const
+{
+    NodeType* node = static_cast<NodeType*>(this->root_);
+    while(node != nullptr) {
+        if(this->comp_(node->getKey(), lo)) {
+            node = node->getRight();
+        } else if(!this->comp_(node->getKey(), hi)) {
+            node = node->getLeft();
+        } else {
+            break;
+        }
+    }
+    if(node == nullptr) return monoid_.identity();
+
+    Aggregate left = suffixAggregate(node->getLeft(), lo);
+    Aggregate right = prefixAggregate(node->getRight(), hi);
+    return monoid_.combine(monoid_.combine(left, monoid_.lift(node->getValue())), right);
+}
+
+/**
+* Returns the aggregate of the keys in a subtree that are not less than
+* lo. Each node on the path that is in range brings its right subtree
+* along, and both come before whatever was collected above it.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::suffixAggregate(NodeType* node, const Key& lo) const
+{
+    Aggregate total = monoid_.identity();
+    while(node != nullptr) {
+        if(this->comp_(node->getKey(), lo)) {
+            node = node->getRight();
+        } else {
+            Aggregate here = monoid_.combine(monoid_.lift(node->getValue()), aggregateOf(node->getRight()));
+            total = monoid_.combine(here, total);
+            node = node->getLeft();
+        }
+    }
+    return total;
+}
+
+/**
+* Returns the aggregate of the keys in a subtree that are less than hi;
+* the mirror image of suffixAggregate.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::prefixAggregate(NodeType* node, const Key& hi) const
+{
+    Aggregate total = monoid_.identity();
+    while(node != nullptr) {
+        if(this->comp_(node->getKey(), hi)) {
+            Aggregate here = monoid_.combine(aggregateOf(node->getLeft()), monoid_.lift(node->getValue()));
+            total = monoid_.combine(total, here);
+            node = node->getRight();
+        } else {
+            node = node->getLeft();
+        }
+    }
+    return total;
+}
+
+/**
+* Returns the cached aggregate of a (possibly empty) subtree.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::aggregateOf(NodeType* node) const
+{
+    return node == nullptr ? monoid_.identity() : node->getAggregate();
+}
+
+/**
+* Splits as AVLTree::split does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::split(const Key& key,
+    AugmentedAVLTree<Key, Value, Monoid, Compare>& left, AugmentedAVLTree<Key, Value, Monoid, Compare>& right)
+{
+    AVLTree<Key, Value, Compare>::split(key, left, right);
+}
+
+/**
+* Joins as AVLTree::join does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::join(AugmentedAVLTree<Key, Value, Monoid, Compare>& left,
+    const std::pair<const Key, Value>& pivot, AugmentedAVLTree<Key, Value, Monoid, Compare>& right)
+{
+    AVLTree<Key, Value, Compare>::join(left, pivot, right);
+}
+
+/**
+* Merges as AVLTree::unionWith does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::unionWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other)
+{
+    AVLTree<Key, Value, Compare>::unionWith(other);
+}
+
+/**
+* Intersects as AVLTree::intersectWith does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::intersectWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other)
+{
+    AVLTree<Key, Value, Compare>::intersectWith(other);
+}
+
+/**
+* Subtracts as AVLTree::differenceWith does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::differenceWith(AugmentedAVLTree<Key, Value, Monoid, Compare>& other)
+{
+    AVLTree<Key, Value, Compare>::differenceWith(other);
+}
+
+/**
+* Returns an iterator to the smallest key; see BinarySearchTree::begin.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::begin() const
+{
+    return iterator(AVLTree<Key, Value, Compare>::begin());
+}
+
+/**
+* Returns the end iterator.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::end() const
+{
+    return iterator(AVLTree<Key, Value, Compare>::end());
+}
+
+/**
+* Finds key as BinarySearchTree::find does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::find(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value, Compare>::find(key));
+}
+
+/**
+* The non-const find, which goes through the lookup cache if it is on.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::find(const Key& key)
+{
+    return iterator(AVLTree<Key, Value, Compare>::find(key));
+}
+
+/**
+* Heterogeneous find; see BinarySearchTree.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename K, typename C, typename>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::find(const K& key) const
+{
+    return iterator(AVLTree<Key, Value, Compare>::find(key));
+}
+
+/**
+* Non-const heterogeneous find, so that it is not ambiguous with find(const Key&).
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename K, typename C, typename>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::find(const K& key)
+{
+    return iterator(AVLTree<Key, Value, Compare>::find(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key, read-only even for a
+ * non-const tree.
+ */
+template<class Key, class Value, class Monoid, class Compare>
+Value const & AugmentedAVLTree<Key, Value, Monoid, Compare>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value, Compare>::operator[](key);
+}
+
+/**
+* Heterogeneous operator[]; see BinarySearchTree.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename K, typename C, typename>
+Value const & AugmentedAVLTree<Key, Value, Monoid, Compare>::operator[](const K& key) const
+{
+    return AVLTree<Key, Value, Compare>::operator[](key);
+}
+
+/**
+* Returns an iterator to the first key not less than key.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value, Compare>::lower_bound(key));
+}
+
+/**
+* Returns an iterator to the first key greater than key.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value, Compare>::upper_bound(key));
+}
+
+/**
+* Returns the range of keys equal to key; see BinarySearchTree::equal_range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator,
+    typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::equal_range(const Key& key) const
+{
+    std::pair<BaseIterator, BaseIterator> bounds = AVLTree<Key, Value, Compare>::equal_range(key);
+    return std::make_pair(iterator(bounds.first), iterator(bounds.second));
+}
+
+/**
+* Returns the keys in [lo, hi); see BinarySearchTree::range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Range
+AugmentedAVLTree<Key, Value, Monoid, Compare>::range(const Key& lo, const Key& hi) const
+{
+    typename BinarySearchTree<Key, Value, Compare>::Range keys = AVLTree<Key, Value, Compare>::range(lo, hi);
+    return Range(iterator(keys.begin()), iterator(keys.end()));
+}
+
+/**
+* Returns an iterator to the k-th smallest key; see AVLTree::select.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::select(std::size_t k) const
+{
+    return iterator(AVLTree<Key, Value, Compare>::select(k));
+}
+
+/**
+* Erases the key at pos and returns an iterator to the next key; see
+* BinarySearchTree::erase.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator
+AugmentedAVLTree<Key, Value, Monoid, Compare>::erase(iterator pos)
+{
+    return iterator(AVLTree<Key, Value, Compare>::erase(pos.it_));
+}
+
+/**
+* Emplaces as BinarySearchTree::emplace does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename... Args>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::emplace(Args&&... args)
+{
+    return wrap(AVLTree<Key, Value, Compare>::emplace(std::forward<Args>(args)...));
+}
+
+/**
+* Inserts as BinarySearchTree::try_emplace does; see there.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename... Args>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    return wrap(AVLTree<Key, Value, Compare>::try_emplace(key, std::forward<Args>(args)...));
+}
+
+/**
+* Like try_emplace(const Key&, ...), but moves the key into the new node.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename... Args>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    return wrap(AVLTree<Key, Value, Compare>::try_emplace(std::move(key), std::forward<Args>(args)...));
+}
+
+/**
+* Inserts or overwrites as BinarySearchTree::insert_or_assign does, which
+* recomputes the aggregates above an overwritten value. This is the way
+* to change a value in place.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename M>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::insert_or_assign(const Key& key, M&& obj)
+{
+    return wrap(AVLTree<Key, Value, Compare>::insert_or_assign(key, std::forward<M>(obj)));
+}
+
+/**
+* Like insert_or_assign(const Key&, obj), but moves the key into a new node.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+template<typename M>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::insert_or_assign(Key&& key, M&& obj)
+{
+    return wrap(AVLTree<Key, Value, Compare>::insert_or_assign(std::move(key), std::forward<M>(obj)));
+}
+
+/**
+* Wraps the iterator of a base tree's (position, inserted) result.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+std::pair<typename AugmentedAVLTree<Key, Value, Monoid, Compare>::iterator, bool>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::wrap(const std::pair<BaseIterator, bool>& result)
+{
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+/**
+* Creates an AugmentedAVLNode; refresh sets its aggregate once it is linked.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+Node<Key, Value>* AugmentedAVLTree<Key, Value, Monoid, Compare>::makeNode(Key&& key, Value&& value,
+    Node<Key, Value>* parent)
+{
+    return this->createNode(std::move(key), std::move(value), static_cast<NodeType*>(parent));
+}
+
+/**
+* Runs ~AugmentedAVLNode, which also destroys the aggregate.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<NodeType*>(node)->~NodeType();
+    this->pool_->deallocate(node);
+}
+
+/**
+* Nodes are only trivial to destroy if the aggregate is as well.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+bool AugmentedAVLTree<Key, Value, Monoid, Compare>::trivialNodes() const
+{
+    return AVLTree<Key, Value, Compare>::trivialNodes() && std::is_trivially_destructible<Aggregate>::value;
+}
+
+/**
+* Aggregates belong to the positions in the tree, like balances and sizes,
+* so they are traded along with them.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    NodeType* a = static_cast<NodeType*>(n1);
+    NodeType* b = static_cast<NodeType*>(n2);
+    Aggregate temp = a->getAggregate();
+    a->setAggregate(b->getAggregate());
+    b->setAggregate(std::move(temp));
+}
+
+/**
+* Recomputes the size and aggregate of node from its children, in key
+* order: left subtree, node, right subtree.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::refresh(AVLNode<Key, Value>* node)
+{
+    AVLTree<Key, Value, Compare>::refresh(node);
+    NodeType* augmented = static_cast<NodeType*>(node);
+    augmented->setAggregate(monoid_.combine(
+        monoid_.combine(aggregateOf(augmented->getLeft()), monoid_.lift(augmented->getValue())),
+        aggregateOf(augmented->getRight())));
+}
+
+/**
+* Unlike sizes, aggregates cannot be adjusted by a delta, so every node
+* on the path is recomputed from its children.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::updatePath(AVLNode<Key, Value>* node, int64_t /*delta*/)
+{
+    for(; node != nullptr; node = node->getParent()) {
+        refresh(node);
+    }
+}
+
+/**
+* An overwritten value changes the aggregate of the node and of every
+* ancestor.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::valueChanged(Node<Key, Value>* node)
+{
+    updatePath(static_cast<AVLNode<Key, Value>*>(node), 0);
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the AugmentedAVLTree class.
+  -------------------------------------------------------
+*/
+
+#endif
@@ -6,6 +6,11 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <stdexcept>
+#include <future>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include "bst.h"
 
 struct KeyError { };
@@ -21,22 +26,29 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // Getter/setter for the number of nodes in the subtree rooted here.
+    uint32_t getSize() const;
+    void setSize(uint32_t size);
+
+    // Getters for parent, left, and right. These hide the Node versions since they
+    // return pointers to AVLNodes - not plain Nodes. They are not virtual: the
+    // static_cast is free, so a traversal step is a single load. See the Node
+    // class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
+    uint32_t size_;     // nodes in this subtree; fits in the padding after balance_
     
     
 
@@ -53,7 +65,17 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent), balance_(0), size_(1)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), balance_(0), size_(1)
 {
 
 }
@@ -95,8 +117,26 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A getter for the number of nodes in the subtree rooted at a AVLNode.
+*/
+template<class Key, class Value>
+uint32_t AVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the number of nodes in the subtree rooted at a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(uint32_t size)
+{
+    size_ = size;
+}
+
+/**
+* A getter for the parent that hides Node::getParent, since a static_cast is necessary to
+* make sure that our node is a AVLNode.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
@@ -105,7 +145,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -114,12 +154,12 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->right_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getRight());
 }
 
 
@@ -130,14 +170,45 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    template<typename InputIterator>
+    AVLTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual ~AVLTree();
+    std::size_t size() const;
+    typename BinarySearchTree<Key, Value, Compare>::iterator select(std::size_t k) const;
+    std::size_t rank(const Key& key) const;
+    void insertBatch(std::vector<std::pair<Key, Value> > batch);
+    void split(const Key& key, AVLTree<Key, Value, Compare>& left, AVLTree<Key, Value, Compare>& right);
+    void join(AVLTree<Key, Value, Compare>& left, const std::pair<const Key, Value>& pivot, AVLTree<Key, Value, Compare>& right);
+    void unionWith(AVLTree<Key, Value, Compare>& other);
+    void intersectWith(AVLTree<Key, Value, Compare>& other);
+    void differenceWith(AVLTree<Key, Value, Compare>& other);
+
+    // What insert's rebalancing has done since the tree was built or the
+    // counters were last reset
+    struct InsertStats
+    {
+        uint64_t inserts;       // keys linked in as new leaves
+        uint64_t retraceSteps;  // ancestors whose balance insert updated
+        uint64_t rotations;     // single rotations; a double one counts two
+    };
+    const InsertStats& insertStats() const;
+    void resetInsertStats();
 protected:
+    AVLTree(std::size_t nodeSize, const Compare& comp);
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual Node<Key, Value>* buildBalanced(std::vector<std::pair<Key, Value> >& items,
+        std::size_t lo, std::size_t hi, Node<Key, Value>* parent);
+    static int8_t builtHeight(std::size_t size);
 
     // Add helper functions here
     //helper functions
@@ -146,71 +217,168 @@ protected:
     void rotateRight(AVLNode<Key, Value>* node);
     void removeFix(AVLNode<Key, Value>* node, int diff);
     AVLNode<Key, Value>* predecessor(AVLNode<Key, Value>* current);
+
+    // Subtree sizes, recomputed bottom-up wherever children change. Derived
+    // trees that cache more per subtree override refresh and updatePath.
+    static uint32_t sizeOf(AVLNode<Key, Value>* node);
+    virtual void refresh(AVLNode<Key, Value>* node);
+    virtual void updatePath(AVLNode<Key, Value>* node, int64_t delta);
+
+    // Join/split helpers. They work on detached subtrees (root has no parent)
+    // and track subtree heights explicitly so each call is O(log n).
+    static int subtreeHeight(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* rebalance(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* mid,
+        AVLNode<Key, Value>* right, int rightHeight, int& height);
+    AVLNode<Key, Value>* splitNodes(AVLNode<Key, Value>* node, int nodeHeight, const Key& key,
+        AVLNode<Key, Value>*& left, int& leftHeight, AVLNode<Key, Value>*& right, int& rightHeight);
+    AVLNode<Key, Value>* joinTwo(AVLNode<Key, Value>* left, int leftHeight,
+        AVLNode<Key, Value>* right, int rightHeight, int& height);
+    AVLNode<Key, Value>* splitLast(AVLNode<Key, Value>* node, int nodeHeight,
+        AVLNode<Key, Value>*& last, int& height);
+    void expose(AVLNode<Key, Value>* node, int nodeHeight,
+        AVLNode<Key, Value>*& left, int& leftHeight, AVLNode<Key, Value>*& right, int& rightHeight);
+
+    // Set operations. Nodes they drop are only collected in garbage and
+    // destroyed once the (possibly parallel) recursion is over, because
+    // the node pool is not thread-safe. forkDepth bounds how many more
+    // levels may still hand one side of the recursion to another thread.
+    typedef std::vector<AVLNode<Key, Value>*> Garbage;
+    typedef AVLNode<Key, Value>* (AVLTree<Key, Value, Compare>::*SetOp)(AVLNode<Key, Value>*, int,
+        AVLNode<Key, Value>*, int, int&, Garbage&, int);
+    struct SetOpCall
+    {
+        AVLNode<Key, Value>* a;
+        int aHeight;
+        AVLNode<Key, Value>* b;
+        int bHeight;
+        AVLNode<Key, Value>* result;
+        int height;
+    };
+    static const int PARALLEL_MIN_HEIGHT = 16;   // a few thousand nodes at least
+    static int maxForkDepth();
+    int forkBudget() const;
+    void runBoth(SetOp op, SetOpCall& left, SetOpCall& right, Garbage& garbage, int forkDepth);
+    void combineWith(SetOp op, AVLTree<Key, Value, Compare>& other);
+    void destroyGarbage(Garbage& garbage);
+    AVLNode<Key, Value>* unionNodes(AVLNode<Key, Value>* a, int aHeight,
+        AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth);
+    AVLNode<Key, Value>* intersectNodes(AVLNode<Key, Value>* a, int aHeight,
+        AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth);
+    AVLNode<Key, Value>* differenceNodes(AVLNode<Key, Value>* a, int aHeight,
+        AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth);
+
+    InsertStats insertStats_;
+    int forkDepth_;             // fork levels for set operations; -1 for maxForkDepth()
+    int parallelMinHeight_;     // smallest subtree height that runBoth forks for
 };
 
-/*
- * Recall: If key is already in the tree, you should 
- * overwrite the current value with the updated value.
- */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+/**
+* Default constructor; sizes the node pool for AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), Compare()),
+    insertStats_(), forkDepth_(-1), parallelMinHeight_(PARALLEL_MIN_HEIGHT)
 {
-    // If the tree is empty
-    if(this->root_ == nullptr) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-        return;
-    }
 
-    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
-    AVLNode<Key, Value>* parent = nullptr;
+}
 
-    // Traverse to insert like in a normal BST
-    while(curr != nullptr) {
-        if(new_item.first == curr->getKey()) {
-            curr->setValue(new_item.second);
-            return;
-        }
-        parent = curr;
-        if(new_item.first < curr->getKey()) {
-            curr = curr->getLeft();
-        } else {
-            curr = curr->getRight();
-        }
-    }
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), comp),
+    insertStats_(), forkDepth_(-1), parallelMinHeight_(PARALLEL_MIN_HEIGHT)
+{
 
-    // Create the new node
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-    if(new_item.first < parent->getKey()) {
-        parent->setLeft(newNode);
-    } else {
-        parent->setRight(newNode);
-    }
+}
 
-    // Start rebalancing
-    if(parent->getLeft() == newNode) {
-        parent->updateBalance(-1);
-    } else {
-        parent->updateBalance(1);
-    }
+/**
+* Range constructor; builds a balanced tree from [first, last) without
+* any rotations. See BinarySearchTree::bulkLoad.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+AVLTree<Key, Value, Compare>::AVLTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), comp),
+    insertStats_(), forkDepth_(-1), parallelMinHeight_(PARALLEL_MIN_HEIGHT)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* For derived trees whose nodes extend AVLNode and so need larger slots.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(std::size_t nodeSize, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(nodeSize, comp),
+    insertStats_(), forkDepth_(-1), parallelMinHeight_(PARALLEL_MIN_HEIGHT)
+{
+
+}
+
+/**
+* Destructor; clears here so that destroyNode still runs ~AVLNode.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::~AVLTree()
+{
+    this->clear();
+}
+
+/**
+* Creates an AVLNode for insert, emplace and the other single-key inserts
+* of the base class, which find where it goes, and for bulk builds and join.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::makeNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    return this->createNode(std::move(key), std::move(value), static_cast<AVLNode<Key, Value>*>(parent));
+}
 
-    insertFix(parent, newNode);
+/**
+* Hangs a new leaf below parent and rebalances up from it.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(node, parent, goLeft);
+    ++insertStats_.inserts;
+    AVLNode<Key, Value>* avlNode = static_cast<AVLNode<Key, Value>*>(node);
+    // A new root needs its cached fields set as much as any other leaf
+    refresh(avlNode);
+    if(parent == nullptr) return;
+
+    AVLNode<Key, Value>* avlParent = static_cast<AVLNode<Key, Value>*>(parent);
+    // Every ancestor gains a node, even above where the retrace stops
+    updatePath(avlParent, 1);
+    avlParent->updateBalance(goLeft ? -1 : 1);
+    ++insertStats_.retraceSteps;
+
+    // A parent that became balanced did not grow, so nothing above it changes
+    if(avlParent->getBalance() != 0) insertFix(avlParent, avlNode);
 }
 
 
 /*
  * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the predecessor and then remove.
+ * should swap with the predecessor and then remove. Reached through
+ * remove and erase; the node is unlinked where the swap leaves it and
+ * the tree rebalanced from its parent up.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeNode(Node<Key, Value>* removed)
 {
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
-    if(node == nullptr) return;
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(removed);
 
     // Case: Two children — swap with predecessor
     if(node->getLeft() != nullptr && node->getRight() != nullptr) {
         AVLNode<Key, Value>* pred = predecessor(node);
         nodeSwap(pred, node);  // already provided
+        // node now has no right child and comes just before pred
+        if(this->threaded_) node->setSuccessorThread(pred);
     }
 
     // Now node has at most one child
@@ -239,33 +407,283 @@ void AVLTree<Key, Value>::remove(const Key& key)
             parent->setRight(child);
     }
 
-    delete node;
+    this->threadPast(node);
+    this->uncache(node);
+    this->destroyNode(node);
+    updatePath(parent, -1);
 
     // Start fixing balance from parent
     removeFix(parent, diff);
 }
 
+/**
+* Returns the number of keys in the tree in O(1).
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::size() const
+{
+    return sizeOf(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* child)
+/**
+* Returns the insert rebalancing counters. retraceSteps / inserts is the
+* average number of levels an insert climbs, and rotations / inserts the
+* rotations it pays for.
+*/
+template<class Key, class Value, class Compare>
+const typename AVLTree<Key, Value, Compare>::InsertStats& AVLTree<Key, Value, Compare>::insertStats() const
 {
-    if(parent == nullptr || parent->getParent() == nullptr) return;
+    return insertStats_;
+}
 
-    AVLNode<Key, Value>* grandparent = parent->getParent();
+/**
+* Zeroes the insert rebalancing counters.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::resetInsertStats()
+{
+    insertStats_ = InsertStats();
+}
 
-    if(parent == grandparent->getLeft()) {
-        grandparent->updateBalance(-1);
-        if(grandparent->getBalance() == 0) return;
-        else if(grandparent->getBalance() == -1)
-            insertFix(grandparent, parent);
-        else if(grandparent->getBalance() == -2) {
+/**
+* Returns an iterator to the k-th smallest key (counting from 0), or
+* end() if k >= size(), in O(log n) using the subtree sizes.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator AVLTree<Key, Value, Compare>::select(std::size_t k) const
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while(node != nullptr) {
+        std::size_t leftSize = sizeOf(node->getLeft());
+        if(k < leftSize) {
+            node = node->getLeft();
+        } else if(k == leftSize) {
+            return this->iteratorAt(node);
+        } else {
+            k -= leftSize + 1;
+            node = node->getRight();
+        }
+    }
+    return this->end();
+}
+
+/**
+* Returns the number of keys less than key, whether or not key itself
+* is in the tree, in O(log n). For a key in the tree this is its index
+* in order, so select(rank(key)) finds it again.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::rank(const Key& key) const
+{
+    std::size_t less = 0;
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while(node != nullptr) {
+        if(this->comp_(node->getKey(), key)) {
+            less += sizeOf(node->getLeft()) + 1;
+            node = node->getRight();
+        } else {
+            node = node->getLeft();
+        }
+    }
+    return less;
+}
+
+
+/**
+* Inserts a batch of pairs in O(m log(n/m + 1)) rather than m separate
+* O(log n) descents. The batch is sorted, built into its own balanced
+* subtree, and merged into the tree with split/join. As with insert,
+* a key that is already present takes the value from the batch (and
+* the last value wins for keys repeated inside the batch).
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertBatch(std::vector<std::pair<Key, Value> > batch)
+{
+    if(batch.empty()) return;
+    this->sortUniqueItems(batch);
+
+    AVLNode<Key, Value>* added = static_cast<AVLNode<Key, Value>*>(
+        this->buildBalanced(batch, 0, batch.size(), nullptr));
+    AVLNode<Key, Value>* existing = static_cast<AVLNode<Key, Value>*>(this->root_);
+
+    int height;
+    Garbage garbage;
+    this->root_ = nullptr;
+    this->root_ = unionNodes(existing, subtreeHeight(existing), added, builtHeight(batch.size()),
+        height, garbage, forkBudget());
+    destroyGarbage(garbage);
+    if(this->threaded_) this->rethread();
+}
+
+/**
+* Adds every pair of other to this tree in O(m log(n/m + 1)) work for
+* sizes m <= n, leaving other empty. Where both trees hold a key the value
+* from other wins, as if each of its pairs had been passed to insert.
+* Large inputs are divided between threads. other's nodes are moved, not
+* copied, and this tree takes over the storage they live in.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::unionWith(AVLTree<Key, Value, Compare>& other)
+{
+    if(&other == this) return;
+    combineWith(&AVLTree<Key, Value, Compare>::unionNodes, other);
+}
+
+/**
+* Keeps only the keys of this tree that other also holds (with the values
+* from this tree) and leaves other empty. Same cost and threading as
+* unionWith.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::intersectWith(AVLTree<Key, Value, Compare>& other)
+{
+    if(&other == this) return;
+    combineWith(&AVLTree<Key, Value, Compare>::intersectNodes, other);
+}
+
+/**
+* Removes every key that other holds from this tree and leaves other empty.
+* Same cost and threading as unionWith.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::differenceWith(AVLTree<Key, Value, Compare>& other)
+{
+    if(&other == this) {
+        this->clear();
+        return;
+    }
+    combineWith(&AVLTree<Key, Value, Compare>::differenceNodes, other);
+}
+
+/**
+* Shared driver of the set operations: takes both node sets out of their
+* trees, merges other's storage into ours, runs op over the two roots and
+* only then destroys the nodes op dropped.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::combineWith(SetOp op, AVLTree<Key, Value, Compare>& other)
+{
+    std::shared_ptr<NodePool> storage;
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(other.takeNodes(storage));
+    this->pool_->adopt(std::move(storage));
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this->root_);
+    this->root_ = nullptr;
+
+    int height;
+    Garbage garbage;
+    this->root_ = (this->*op)(a, subtreeHeight(a), b, subtreeHeight(b), height, garbage, forkBudget());
+    destroyGarbage(garbage);
+    // Nodes that come from a threaded tree carry threads; other's may point anywhere
+    if(this->threaded_ || other.threaded_) this->rethread();
+}
+
+/**
+* Moves every key less than key into left and every other key into right
+* in O(log n), leaving this tree empty. Whatever left and right held
+* before is cleared. The two halves keep sharing this tree's node storage,
+* so no node is copied or reallocated. left or right may be this tree.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::split(const Key& key, AVLTree<Key, Value, Compare>& left, AVLTree<Key, Value, Compare>& right)
+{
+    if(&left == &right) throw std::invalid_argument("split needs two distinct trees");
+
+    std::shared_ptr<NodePool> storage;
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->takeNodes(storage));
+    left.clear();
+    right.clear();
+
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    int leftHeight, rightHeight;
+    AVLNode<Key, Value>* found = splitNodes(root, subtreeHeight(root), key, l, leftHeight, r, rightHeight);
+    if(found != nullptr) {
+        // The split key itself starts the right half
+        int height;
+        r = joinNodes(nullptr, 0, found, r, rightHeight, height);
+    }
+
+    left.pool_ = storage;
+    left.root_ = l;
+    right.pool_ = storage;
+    right.root_ = r;
+    if(this->threaded_ || left.threaded_ || right.threaded_) {
+        left.rethread();
+        right.rethread();
+    }
+}
+
+/**
+* Replaces the contents of this tree with left, the pivot pair, and right
+* in O(log n), leaving left and right empty. Every key in left must be
+* less than the pivot's key and every key in right greater, otherwise
+* std::invalid_argument is thrown and nothing changes. If copying the
+* pivot throws, left and right are unchanged too. This tree takes over
+* the storage of both inputs. left or right may be this tree.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(AVLTree<Key, Value, Compare>& left, const std::pair<const Key, Value>& pivot,
+    AVLTree<Key, Value, Compare>& right)
+{
+    if(&left == &right) throw std::invalid_argument("join needs two distinct trees");
+
+    Node<Key, Value>* largest = left.root_;
+    while(largest != nullptr && largest->getRight() != nullptr) largest = largest->getRight();
+    Node<Key, Value>* smallest = right.getSmallestNode();
+    if((largest != nullptr && !this->comp_(largest->getKey(), pivot.first)) ||
+       (smallest != nullptr && !this->comp_(pivot.first, smallest->getKey()))) {
+        throw std::invalid_argument("join keys are out of order");
+    }
+
+    // Make the pivot's node while left and right still own their nodes, so
+    // that if it throws they are left as they were
+    if(this != &left && this != &right) this->clear();
+    AVLNode<Key, Value>* mid = static_cast<AVLNode<Key, Value>*>(
+        this->makeNode(Key(pivot.first), Value(pivot.second), nullptr));
+
+    std::shared_ptr<NodePool> leftStorage, rightStorage;
+    AVLNode<Key, Value>* l = static_cast<AVLNode<Key, Value>*>(left.takeNodes(leftStorage));
+    AVLNode<Key, Value>* r = static_cast<AVLNode<Key, Value>*>(right.takeNodes(rightStorage));
+    this->pool_->adopt(std::move(leftStorage));
+    this->pool_->adopt(std::move(rightStorage));
+
+    int height;
+    this->root_ = joinNodes(l, subtreeHeight(l), mid, r, subtreeHeight(r), height);
+    if(this->threaded_ || left.threaded_ || right.threaded_) this->rethread();
+}
+
+/**
+* Climbs from parent, whose subtree just grew by a level on child's side,
+* updating balances until some ancestor absorbs the growth: either its
+* balance returns to 0, or one single or double rotation brings the
+* subtree back to its old height. A loop rather than a recursion, so the
+* climb is one pass over nodes the insert's descent left in cache.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* child)
+{
+    while(parent != nullptr) {
+        AVLNode<Key, Value>* grandparent = parent->getParent();
+        if(grandparent == nullptr) return;
+        ++insertStats_.retraceSteps;
+
+        if(parent == grandparent->getLeft()) {
+            grandparent->updateBalance(-1);
+            if(grandparent->getBalance() == 0) return;
+            if(grandparent->getBalance() == -1) {
+                child = parent;
+                parent = grandparent;
+                continue;
+            }
             if(child == parent->getLeft()) {
                 rotateRight(grandparent);
+                ++insertStats_.rotations;
                 parent->setBalance(0);
                 grandparent->setBalance(0);
             } else {
                 rotateLeft(parent);
                 rotateRight(grandparent);
+                insertStats_.rotations += 2;
                 int8_t childBalance = child->getBalance();
                 if(childBalance == -1) {
                     parent->setBalance(0);
@@ -279,20 +697,23 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Va
                 }
                 child->setBalance(0);
             }
-        }
-    } else {
-        grandparent->updateBalance(1);
-        if(grandparent->getBalance() == 0) return;
-        else if(grandparent->getBalance() == 1)
-            insertFix(grandparent, parent);
-        else if(grandparent->getBalance() == 2) {
+        } else {
+            grandparent->updateBalance(1);
+            if(grandparent->getBalance() == 0) return;
+            if(grandparent->getBalance() == 1) {
+                child = parent;
+                parent = grandparent;
+                continue;
+            }
             if(child == parent->getRight()) {
                 rotateLeft(grandparent);
+                ++insertStats_.rotations;
                 parent->setBalance(0);
                 grandparent->setBalance(0);
             } else {
                 rotateRight(parent);
                 rotateLeft(grandparent);
+                insertStats_.rotations += 2;
                 int8_t childBalance = child->getBalance();
                 if(childBalance == 1) {
                     parent->setBalance(0);
@@ -307,49 +728,36 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Va
                 child->setBalance(0);
             }
         }
+        // After a rotation the subtree is as tall as before the insert
+        return;
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
+/**
+* Rotates through the base class, then recomputes the sizes of the two
+* nodes that changed children, lower one first.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateLeft(AVLNode<Key, Value>* x)
 {
-    AVLNode<Key, Value>* y = x->getRight();
-    x->setRight(y->getLeft());
-    if(y->getLeft() != nullptr) y->getLeft()->setParent(x);
-    y->setParent(x->getParent());
-
-    if(x->getParent() == nullptr)
-        this->root_ = y;
-    else if(x == x->getParent()->getLeft())
-        x->getParent()->setLeft(y);
-    else
-        x->getParent()->setRight(y);
-
-    y->setLeft(x);
-    x->setParent(y);
+    BinarySearchTree<Key, Value, Compare>::rotateLeft(x);
+    refresh(x);
+    refresh(x->getParent());
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* x)
+/**
+* The mirror image of rotateLeft.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateRight(AVLNode<Key, Value>* x)
 {
-    AVLNode<Key, Value>* y = x->getLeft();
-    x->setLeft(y->getRight());
-    if(y->getRight() != nullptr) y->getRight()->setParent(x);
-    y->setParent(x->getParent());
-
-    if(x->getParent() == nullptr)
-        this->root_ = y;
-    else if(x == x->getParent()->getLeft())
-        x->getParent()->setLeft(y);
-    else
-        x->getParent()->setRight(y);
-
-    y->setRight(x);
-    x->setParent(y);
+    BinarySearchTree<Key, Value, Compare>::rotateRight(x);
+    refresh(x);
+    refresh(x->getParent());
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeFix(AVLNode<Key, Value>* node, int diff)
 {
     while(node != nullptr) {
         node->updateBalance(diff);
@@ -370,9 +778,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
                 } else {
                     node->setBalance(0);
                     left->setBalance(0);
-                    node = left->getParent();
-                    diff = 1;
-                    continue;
+                    // The rotated subtree shrank; keep retracing from its new root
+                    node = left;
                 }
             } else {
                 AVLNode<Key, Value>* child = left->getRight();
@@ -393,9 +800,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
                 }
 
                 child->setBalance(0);
-                node = child->getParent();
-                diff = 1;
-                continue;
+                // The rotated subtree shrank; keep retracing from its new root
+                node = child;
             }
         }
 
@@ -412,9 +818,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
                 } else {
                     node->setBalance(0);
                     right->setBalance(0);
-                    node = right->getParent();
-                    diff = -1;
-                    continue;
+                    // The rotated subtree shrank; keep retracing from its new root
+                    node = right;
                 }
             } else {
                 AVLNode<Key, Value>* child = right->getLeft();
@@ -435,9 +840,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
                 }
 
                 child->setBalance(0);
-                node = child->getParent();
-                diff = -1;
-                continue;
+                // The rotated subtree shrank; keep retracing from its new root
+                node = child;
             }
         }
 
@@ -453,8 +857,8 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
     }
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* current)
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::predecessor(AVLNode<Key, Value>* current)
 {
     if(current->getLeft() != nullptr) {
         AVLNode<Key, Value>* pred = current->getLeft();
@@ -473,13 +877,512 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* curre
 
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+/**
+* Destroys an AVLNode and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<AVLNode<Key, Value>*>(node)->~AVLNode();
+    this->pool_->deallocate(node);
+}
+
+/**
+* Builds a balanced subtree of AVLNodes from items[lo, hi). Both halves
+* of every node are built the same way, so their heights follow from
+* their sizes and each balance is set directly with no rotations.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::buildBalanced(std::vector<std::pair<Key, Value> >& items,
+    std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if(lo >= hi) return nullptr;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(
+        this->makeNode(std::move(items[mid].first), std::move(items[mid].second), parent));
+    node->setLeft(buildBalanced(items, lo, mid, node));
+    node->setRight(buildBalanced(items, mid + 1, hi, node));
+    node->setBalance(builtHeight(hi - mid - 1) - builtHeight(mid - lo));
+    refresh(node);
+    return node;
+}
+
+/**
+* Height of a subtree of the given size built by buildBalanced, which
+* is the number of bits needed to write the size.
+*/
+template<class Key, class Value, class Compare>
+int8_t AVLTree<Key, Value, Compare>::builtHeight(std::size_t size)
+{
+    int8_t height = 0;
+    while(size != 0) {
+        ++height;
+        size >>= 1;
+    }
+    return height;
+}
+/**
+* Returns the number of nodes in a (possibly empty) subtree.
+*/
+template<class Key, class Value, class Compare>
+uint32_t AVLTree<Key, Value, Compare>::sizeOf(AVLNode<Key, Value>* node)
+{
+    return node == nullptr ? 0 : node->getSize();
+}
+
+/**
+* Recomputes the size of node from its children, which must be up to date.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::refresh(AVLNode<Key, Value>* node)
+{
+    node->setSize(sizeOf(node->getLeft()) + sizeOf(node->getRight()) + 1);
+}
+
+/**
+* Adds delta to the size of node and of each of its ancestors, after
+* delta nodes were linked in (or unlinked) below node. Unlike refresh
+* this reads nothing but the path itself, which the caller has just
+* walked down and so is still in cache. It must run before any rotation
+* on the path, since a rotation refreshes from the children's sizes.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::updatePath(AVLNode<Key, Value>* node, int64_t delta)
+{
+    for(; node != nullptr; node = node->getParent()) {
+        node->setSize(static_cast<uint32_t>(node->getSize() + delta));
+    }
+}
+
+/**
+* Computes the height of a subtree in O(log n) by following the
+* taller child at each level, as recorded by the balances.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::subtreeHeight(AVLNode<Key, Value>* node)
+{
+    int height = 0;
+    while(node != nullptr) {
+        ++height;
+        node = node->getBalance() < 0 ? node->getLeft() : node->getRight();
+    }
+    return height;
+}
+
+/**
+* Restores balance at a node whose balance is -2 or +2 with one or two
+* rotations and returns the new root of that subtree. Unlike insertFix,
+* the taller child may itself be balanced (as after a removal or join).
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::rebalance(AVLNode<Key, Value>* node)
+{
+    if(node->getBalance() < 0) {
+        AVLNode<Key, Value>* left = node->getLeft();
+        int8_t leftBal = left->getBalance();
+        if(leftBal <= 0) {
+            rotateRight(node);
+            node->setBalance(leftBal == 0 ? -1 : 0);
+            left->setBalance(leftBal == 0 ? 1 : 0);
+            return left;
+        }
+        AVLNode<Key, Value>* child = left->getRight();
+        int8_t childBal = child->getBalance();
+        rotateLeft(left);
+        rotateRight(node);
+        node->setBalance(childBal == -1 ? 1 : 0);
+        left->setBalance(childBal == 1 ? -1 : 0);
+        child->setBalance(0);
+        return child;
+    }
+
+    AVLNode<Key, Value>* right = node->getRight();
+    int8_t rightBal = right->getBalance();
+    if(rightBal >= 0) {
+        rotateLeft(node);
+        node->setBalance(rightBal == 0 ? 1 : 0);
+        right->setBalance(rightBal == 0 ? -1 : 0);
+        return right;
+    }
+    AVLNode<Key, Value>* child = right->getLeft();
+    int8_t childBal = child->getBalance();
+    rotateRight(right);
+    rotateLeft(node);
+    node->setBalance(childBal == 1 ? -1 : 0);
+    right->setBalance(childBal == -1 ? 1 : 0);
+    child->setBalance(0);
+    return child;
+}
+
+/**
+* Joins two detached subtrees around a single detached node, where every
+* key in left < mid's key < every key in right. The shorter tree is hung
+* off the spine of the taller one at the matching height and the path is
+* retraced like an insertion, so the cost is O(|leftHeight - rightHeight| + 1).
+* Returns the new root and stores its height in height.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key, Value>* left, int leftHeight,
+    AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    mid->setParent(nullptr);
+    if(leftHeight - rightHeight <= 1 && rightHeight - leftHeight <= 1) {
+        mid->setLeft(left);
+        mid->setRight(right);
+        if(left != nullptr) left->setParent(mid);
+        if(right != nullptr) right->setParent(mid);
+        mid->setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+        refresh(mid);
+        height = std::max(leftHeight, rightHeight) + 1;
+        return mid;
+    }
+
+    bool tallLeft = leftHeight > rightHeight;
+    AVLNode<Key, Value>* root = tallLeft ? left : right;
+    int shortHeight = tallLeft ? rightHeight : leftHeight;
+
+    // Walk down the inner spine of the taller tree to the first subtree
+    // that is no more than one level taller than the shorter tree
+    AVLNode<Key, Value>* parent = nullptr;
+    AVLNode<Key, Value>* spine = root;
+    int spineHeight = tallLeft ? leftHeight : rightHeight;
+    while(spineHeight > shortHeight + 1) {
+        parent = spine;
+        if(tallLeft) {
+            spineHeight -= spine->getBalance() < 0 ? 2 : 1;
+            spine = spine->getRight();
+        } else {
+            spineHeight -= spine->getBalance() > 0 ? 2 : 1;
+            spine = spine->getLeft();
+        }
+    }
+
+    if(tallLeft) {
+        mid->setLeft(spine);
+        mid->setRight(right);
+        if(right != nullptr) right->setParent(mid);
+        mid->setBalance(static_cast<int8_t>(shortHeight - spineHeight));
+        parent->setRight(mid);
+    } else {
+        mid->setLeft(left);
+        mid->setRight(spine);
+        if(left != nullptr) left->setParent(mid);
+        mid->setBalance(static_cast<int8_t>(spineHeight - shortHeight));
+        parent->setLeft(mid);
+    }
+    if(spine != nullptr) spine->setParent(mid);
+    mid->setParent(parent);
+    refresh(mid);
+
+    // Only the spine above mid gains nodes, and it is O(leftHeight - rightHeight) long
+    updatePath(parent, int64_t(mid->getSize()) - sizeOf(spine));
+
+    // mid's subtree is one level taller than the spine subtree it replaced
+    height = tallLeft ? leftHeight : rightHeight;
+    AVLNode<Key, Value>* child = mid;
+    AVLNode<Key, Value>* node = parent;
+    while(node != nullptr) {
+        node->updateBalance(child == node->getLeft() ? -1 : 1);
+        int8_t bal = node->getBalance();
+        if(bal == 0) break;
+        if(bal == 2 || bal == -2) {
+            AVLNode<Key, Value>* top = rebalance(node);
+            if(node == root) root = top;
+            if(top->getBalance() == 0) break;
+            node = top;
+        }
+        child = node;
+        node = node->getParent();
+    }
+    if(node == nullptr) ++height;
+    return root;
+}
+
+/**
+* Splits a detached subtree of the given height around key. Keys less than
+* key end up in left and greater keys in right (both detached, with their
+* heights reported). If a node with the key exists it is detached and
+* returned, otherwise nullptr. Runs in O(log n) since the joins along the
+* way telescope.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::splitNodes(AVLNode<Key, Value>* node, int nodeHeight, const Key& key,
+    AVLNode<Key, Value>*& left, int& leftHeight, AVLNode<Key, Value>*& right, int& rightHeight)
+{
+    if(node == nullptr) {
+        left = right = nullptr;
+        leftHeight = rightHeight = 0;
+        return nullptr;
+    }
+
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    int lh, rh;
+    expose(node, nodeHeight, l, lh, r, rh);
+
+    if(this->comp_(key, node->getKey())) {
+        AVLNode<Key, Value>* between;
+        int betweenHeight;
+        AVLNode<Key, Value>* found = splitNodes(l, lh, key, left, leftHeight, between, betweenHeight);
+        right = joinNodes(between, betweenHeight, node, r, rh, rightHeight);
+        return found;
+    }
+    if(this->comp_(node->getKey(), key)) {
+        AVLNode<Key, Value>* between;
+        int betweenHeight;
+        AVLNode<Key, Value>* found = splitNodes(r, rh, key, between, betweenHeight, right, rightHeight);
+        left = joinNodes(l, lh, node, between, betweenHeight, leftHeight);
+        return found;
+    }
+    left = l;
+    leftHeight = lh;
+    right = r;
+    rightHeight = rh;
+    return node;
+}
+
+/**
+* Detaches the children of the root of a detached subtree, reporting them
+* with their heights, and leaves node as a lone node.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::expose(AVLNode<Key, Value>* node, int nodeHeight,
+    AVLNode<Key, Value>*& left, int& leftHeight, AVLNode<Key, Value>*& right, int& rightHeight)
+{
+    left = node->getLeft();
+    right = node->getRight();
+    leftHeight = nodeHeight - (node->getBalance() > 0 ? 2 : 1);
+    rightHeight = nodeHeight - (node->getBalance() < 0 ? 2 : 1);
+    if(left != nullptr) left->setParent(nullptr);
+    if(right != nullptr) right->setParent(nullptr);
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+    node->setParent(nullptr);
+    node->setBalance(0);
+    refresh(node);
+}
+
+/**
+* Removes the largest node of a detached subtree in O(log n), storing it
+* (detached) in last. Returns the rest of the subtree and its height.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::splitLast(AVLNode<Key, Value>* node, int nodeHeight,
+    AVLNode<Key, Value>*& last, int& height)
+{
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    int lh, rh;
+    expose(node, nodeHeight, l, lh, r, rh);
+    if(r == nullptr) {
+        last = node;
+        height = lh;
+        return l;
+    }
+    int restHeight;
+    AVLNode<Key, Value>* rest = splitLast(r, rh, last, restHeight);
+    return joinNodes(l, lh, node, rest, restHeight, height);
+}
+
+/**
+* Joins two detached subtrees where every key in left < every key in
+* right, without a middle node: the largest node of left is taken out
+* and used as the pivot. O(log n).
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinTwo(AVLNode<Key, Value>* left, int leftHeight,
+    AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    if(left == nullptr) {
+        height = rightHeight;
+        return right;
+    }
+    if(right == nullptr) {
+        height = leftHeight;
+        return left;
+    }
+    AVLNode<Key, Value>* last;
+    int restHeight;
+    AVLNode<Key, Value>* rest = splitLast(left, leftHeight, last, restHeight);
+    return joinNodes(rest, restHeight, last, right, rightHeight, height);
+}
+
+/**
+* Returns how many levels of a set operation may fork: enough for every
+* hardware thread to get a piece, plus one level of slack so uneven
+* splits still keep the cores busy. 0 means run serially.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::maxForkDepth()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    if(threads <= 1) return 0;
+    int depth = 1;
+    while((1u << depth) < threads) ++depth;
+    return depth + 1;
+}
+
+/**
+* Returns the fork depth a set operation starts with: maxForkDepth()
+* unless forkDepth_ overrides it, as tests do to reach the parallel path
+* on any machine.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::forkBudget() const
+{
+    return forkDepth_ < 0 ? maxForkDepth() : forkDepth_;
+}
+
+/**
+* Runs op on the two independent halves of a set operation. When both
+* halves are big enough and the fork budget allows, the left half runs
+* on its own thread while this thread does the right one (or serially if
+* no thread can be started). The halves
+* touch disjoint nodes and never the pool, so they need no locking.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::runBoth(SetOp op, SetOpCall& left, SetOpCall& right,
+    Garbage& garbage, int forkDepth)
+{
+    int leftSize = std::max(left.aHeight, left.bHeight);
+    int rightSize = std::max(right.aHeight, right.bHeight);
+    Garbage leftGarbage;
+    std::future<AVLNode<Key, Value>*> leftTask;
+    if(forkDepth > 0 && std::min(leftSize, rightSize) >= parallelMinHeight_) {
+        try {
+            leftTask = std::async(std::launch::async, [&]() {
+                return (this->*op)(left.a, left.aHeight, left.b, left.bHeight, left.height,
+                    leftGarbage, forkDepth - 1);
+            });
+        }
+        catch(const std::system_error&) {
+            // Out of threads; just carry on serially
+        }
+    }
+    if(!leftTask.valid()) {
+        left.result = (this->*op)(left.a, left.aHeight, left.b, left.bHeight, left.height, garbage, 0);
+        right.result = (this->*op)(right.a, right.aHeight, right.b, right.bHeight, right.height, garbage, 0);
+        return;
+    }
+
+    try {
+        right.result = (this->*op)(right.a, right.aHeight, right.b, right.bHeight, right.height,
+            garbage, forkDepth - 1);
+    }
+    catch(...) {
+        leftTask.wait();
+        throw;
+    }
+    left.result = leftTask.get();
+    garbage.insert(garbage.end(), leftGarbage.begin(), leftGarbage.end());
+}
+
+/**
+* Destroys every subtree collected by a set operation.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destroyGarbage(Garbage& garbage)
+{
+    for(std::size_t i = 0; i < garbage.size(); ++i) {
+        this->destroySubtree(garbage[i]);
+    }
+    garbage.clear();
+}
+
+/**
+* Merges two detached subtrees into one, splitting b around the root of a
+* and recursing on both sides (the join-based union). Where both contain a
+* key, a's node is kept and takes b's value, and b's node is dropped.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::unionNodes(AVLNode<Key, Value>* a, int aHeight,
+    AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth)
+{
+    if(a == nullptr) {
+        height = bHeight;
+        return b;
+    }
+    if(b == nullptr) {
+        height = aHeight;
+        return a;
+    }
+
+    SetOpCall left, right;
+    expose(a, aHeight, left.a, left.aHeight, right.a, right.aHeight);
+    AVLNode<Key, Value>* dup = splitNodes(b, bHeight, a->getKey(), left.b, left.bHeight, right.b, right.bHeight);
+    if(dup != nullptr) {
+        a->getValue() = std::move(dup->getValue());
+        garbage.push_back(dup);
+    }
+
+    runBoth(&AVLTree<Key, Value, Compare>::unionNodes, left, right, garbage, forkDepth);
+    return joinNodes(left.result, left.height, a, right.result, right.height, height);
+}
+
+/**
+* Keeps the nodes of a whose keys also appear in b, splitting b around the
+* root of a and recursing on both sides. Every node of b is dropped.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::intersectNodes(AVLNode<Key, Value>* a, int aHeight,
+    AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth)
+{
+    if(a == nullptr || b == nullptr) {
+        if(a != nullptr) garbage.push_back(a);
+        if(b != nullptr) garbage.push_back(b);
+        height = 0;
+        return nullptr;
+    }
+
+    SetOpCall left, right;
+    expose(a, aHeight, left.a, left.aHeight, right.a, right.aHeight);
+    AVLNode<Key, Value>* dup = splitNodes(b, bHeight, a->getKey(), left.b, left.bHeight, right.b, right.bHeight);
+
+    runBoth(&AVLTree<Key, Value, Compare>::intersectNodes, left, right, garbage, forkDepth);
+    if(dup != nullptr) {
+        garbage.push_back(dup);
+        return joinNodes(left.result, left.height, a, right.result, right.height, height);
+    }
+    garbage.push_back(a);
+    return joinTwo(left.result, left.height, right.result, right.height, height);
+}
+
+/**
+* Keeps the nodes of a whose keys do not appear in b, splitting a around
+* the root of b and recursing on both sides. Every node of b is dropped.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::differenceNodes(AVLNode<Key, Value>* a, int aHeight,
+    AVLNode<Key, Value>* b, int bHeight, int& height, Garbage& garbage, int forkDepth)
+{
+    if(a == nullptr || b == nullptr) {
+        if(b != nullptr) garbage.push_back(b);
+        height = aHeight;
+        return a;
+    }
+
+    SetOpCall left, right;
+    expose(b, bHeight, left.b, left.bHeight, right.b, right.bHeight);
+    AVLNode<Key, Value>* found = splitNodes(a, aHeight, b->getKey(), left.a, left.aHeight, right.a, right.aHeight);
+    if(found != nullptr) garbage.push_back(found);
+    garbage.push_back(b);
+
+    runBoth(&AVLTree<Key, Value, Compare>::differenceNodes, left, right, garbage, forkDepth);
+    return joinTwo(left.result, left.height, right.result, right.height, height);
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    // Sizes belong to the positions, which the nodes just traded
+    uint32_t tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
 }
 
 
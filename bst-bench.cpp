@@ -0,0 +1,925 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include "bst.h"
+#include "avlbst.h"
+#include "augmented_avl.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "rbbst.h"
+#include "sharded_map.h"
+#include "splaybst.h"
+#include "treap.h"
+#include "wavlbst.h"
+#include "btree.h"
+
+using namespace std;
+
+// Seconds elapsed since start.
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Prints one result line as millions of operations per second.
+static void report(const string& name, size_t ops, double secs)
+{
+    cout << left << setw(32) << name << right << setw(10) << fixed << setprecision(2)
+         << (ops / secs) / 1e6 << " Mops/s  (" << setprecision(3) << secs << " s)" << endl;
+}
+
+// n distinct keys in random order.
+static vector<uint64_t> shuffledKeys(size_t n, uint64_t seed)
+{
+    vector<uint64_t> keys(n);
+    for(size_t i = 0; i < n; ++i) keys[i] = i * 2 + 1;
+    shuffle(keys.begin(), keys.end(), mt19937_64(seed));
+    return keys;
+}
+
+// A uint64_t that the trees can only compare with operator<, so
+// BTree falls back to its generic binary search within a node.
+struct OpaqueKey
+{
+    OpaqueKey() : value(0) { }
+    OpaqueKey(uint64_t v) : value(v) { }
+    operator uint64_t() const { return value; }
+    bool operator<(const OpaqueKey& rhs) const { return value < rhs.value; }
+    uint64_t value;
+};
+
+// Insert every key, then look every key up again in a different order.
+template<typename Tree>
+static void benchInsertFind(const string& name, const vector<uint64_t>& keys)
+{
+    Tree tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    report(name + " insert", keys.size(), secondsSince(start));
+
+    vector<uint64_t> probes(keys.rbegin(), keys.rend());
+    uint64_t sum = 0;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < probes.size(); ++i) {
+        sum += tree.find(probes[i])->second;
+    }
+    report(name + " find", probes.size(), secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        sum += it->first;
+    }
+    report(name + " scan", keys.size(), secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// Remove every key, in a different order than it was inserted.
+template<typename Tree>
+static void benchRemove(const string& name, const vector<uint64_t>& keys)
+{
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    vector<uint64_t> order(keys);
+    shuffle(order.begin(), order.end(), mt19937_64(2));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < order.size(); ++i) {
+        tree.remove(order[i]);
+    }
+    report(name + " remove", order.size(), secondsSince(start));
+}
+
+// One step of a mixed workload
+struct Op
+{
+    enum Kind { INSERT, REMOVE, FIND } kind;
+    uint64_t key;
+};
+
+// n operations on keys drawn from [0, 2n), inserts, removes and finds
+// in the given percentages.
+static vector<Op> makeOps(size_t n, unsigned insertPct, unsigned removePct, uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    vector<Op> ops(n);
+    for(size_t i = 0; i < n; ++i) {
+        unsigned roll = rng() % 100;
+        ops[i].kind = roll < insertPct ? Op::INSERT : roll < insertPct + removePct ? Op::REMOVE : Op::FIND;
+        ops[i].key = rng() % (2 * n);
+    }
+    return ops;
+}
+
+// Load initial, then time ops.
+template<typename Tree>
+static void benchWorkload(const string& name, const vector<uint64_t>& initial, const vector<Op>& ops)
+{
+    Tree tree;
+    for(size_t i = 0; i < initial.size(); ++i) tree.insert(make_pair(initial[i], initial[i]));
+    uint64_t found = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < ops.size(); ++i) {
+        if(ops[i].kind == Op::INSERT) tree.insert(make_pair(ops[i].key, ops[i].key));
+        else if(ops[i].kind == Op::REMOVE) tree.remove(ops[i].key);
+        else found += tree.find(ops[i].key) != tree.end();
+    }
+    report(name, ops.size(), secondsSince(start));
+    if(found == 42) cout << "";
+}
+
+// The same workload on each balancing scheme.
+static void benchEngines(const string& workload, const vector<uint64_t>& initial, const vector<Op>& ops)
+{
+    benchWorkload<AVLTree<uint64_t, uint64_t> >(workload + " avl", initial, ops);
+    benchWorkload<RedBlackTree<uint64_t, uint64_t> >(workload + " red-black", initial, ops);
+    benchWorkload<WAVLTree<uint64_t, uint64_t> >(workload + " wavl", initial, ops);
+    benchWorkload<Treap<uint64_t, uint64_t> >(workload + " treap", initial, ops);
+}
+
+// Drop every other key in key order, once by remove(key) and once by
+// erase(iterator) during a single in-order walk.
+template<typename Tree>
+static void benchErase(const string& name, const vector<uint64_t>& keys)
+{
+    vector<uint64_t> sorted(keys);
+    sort(sorted.begin(), sorted.end());
+    {
+        Tree tree;
+        for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(size_t i = 0; i < sorted.size(); i += 2) tree.remove(sorted[i]);
+        report(name + " remove(key)", sorted.size() / 2, secondsSince(start));
+    }
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ) {
+        it = tree.erase(it);
+        if(it != tree.end()) ++it;
+    }
+    report(name + " erase(iterator)", sorted.size() / 2, secondsSince(start));
+}
+
+// Time clear() on a tree built from the given key order.
+template<typename Tree, typename Value>
+static void benchClear(const string& name, const vector<uint64_t>& keys, const Value& value)
+{
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], value));
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    tree.clear();
+    report(name + " clear", keys.size(), secondsSince(start));
+}
+
+// Load sorted pairs one insert at a time versus through bulkLoad.
+static void benchBulkLoad(size_t n)
+{
+    vector<pair<uint64_t, uint64_t> > items(n);
+    for(size_t i = 0; i < n; ++i) items[i] = make_pair(uint64_t(i), uint64_t(i));
+
+    AVLTree<uint64_t, uint64_t> inserted;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        inserted.insert(items[i]);
+    }
+    report("avl insert sorted", n, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    AVLTree<uint64_t, uint64_t> loaded(items.begin(), items.end());
+    report("avl bulkLoad sorted", n, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    BinarySearchTree<uint64_t, uint64_t> bst(items.begin(), items.end());
+    report("bst bulkLoad sorted", n, secondsSince(start));
+}
+
+// Merge a batch of m random keys into a tree of n keys, per key versus insertBatch.
+static void benchBatch(size_t n, size_t m)
+{
+    vector<uint64_t> keys = shuffledKeys(n + m, 3);
+    vector<pair<uint64_t, uint64_t> > base, batch;
+    for(size_t i = 0; i < n; ++i) base.push_back(make_pair(keys[i], keys[i]));
+    for(size_t i = n; i < n + m; ++i) batch.push_back(make_pair(keys[i], keys[i]));
+
+    string label = "m=" + to_string(m);
+    AVLTree<uint64_t, uint64_t> perKey(base.begin(), base.end());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < m; ++i) {
+        perKey.insert(batch[i]);
+    }
+    report("avl insert " + label, m, secondsSince(start));
+
+    AVLTree<uint64_t, uint64_t> batched(base.begin(), base.end());
+    start = chrono::steady_clock::now();
+    batched.insertBatch(batch);
+    report("avl insertBatch " + label, m, secondsSince(start));
+}
+
+// Combine two random trees of n keys (half of them shared) per key versus
+// with the join-based set operations.
+static void benchSetOps(size_t n)
+{
+    vector<uint64_t> keys = shuffledKeys(n + n / 2, 4);
+    vector<pair<uint64_t, uint64_t> > first, second;
+    for(size_t i = 0; i < n; ++i) first.push_back(make_pair(keys[i], keys[i]));
+    for(size_t i = n / 2; i < n + n / 2; ++i) second.push_back(make_pair(keys[i], keys[i]));
+
+    AVLTree<uint64_t, uint64_t> perKey(first.begin(), first.end());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < second.size(); ++i) {
+        perKey.insert(second[i]);
+    }
+    report("avl insert each (union)", n, secondsSince(start));
+
+    const char* names[] = { "avl unionWith", "avl intersectWith", "avl differenceWith" };
+    for(int op = 0; op < 3; ++op) {
+        AVLTree<uint64_t, uint64_t> a(first.begin(), first.end());
+        AVLTree<uint64_t, uint64_t> b(second.begin(), second.end());
+        start = chrono::steady_clock::now();
+        if(op == 0) a.unionWith(b);
+        else if(op == 1) a.intersectWith(b);
+        else a.differenceWith(b);
+        report(names[op], n, secondsSince(start));
+    }
+}
+
+// Random lookups in a tree versus in its frozen snapshot.
+static void benchFrozen(size_t n)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 5);
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < n; ++i) items.push_back(make_pair(keys[i], keys[i]));
+    AVLTree<uint64_t, uint64_t> tree(items.begin(), items.end());
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    FrozenMap<uint64_t, uint64_t> frozen = tree.freeze();
+    report("avl freeze", n, secondsSince(start));
+
+    // Half of the probes miss
+    vector<uint64_t> probes(keys);
+    for(size_t i = 0; i < n; i += 2) probes[i] += 1;
+    uint64_t sum = 0;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        BinarySearchTree<uint64_t, uint64_t>::iterator it = tree.find(probes[i]);
+        if(it != tree.end()) sum += it->second;
+    }
+    report("avl find", n, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        const uint64_t* value = frozen.find(probes[i]);
+        if(value != NULL) sum += *value;
+    }
+    report("frozen find", n, secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// Insert large string values by copying them in, by moving them in, and
+// with try_emplace, then insert every key again so each insert finds it.
+static void benchEmplace(size_t n)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 6);
+    const string value(256, 'v');
+
+    AVLTree<uint64_t, string> copied;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        const pair<const uint64_t, string> item(keys[i], value);
+        copied.insert(item);
+    }
+    report("avl insert copy", n, secondsSince(start));
+
+    AVLTree<uint64_t, string> moved;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        moved.insert(pair<const uint64_t, string>(keys[i], value));
+    }
+    report("avl insert move", n, secondsSince(start));
+
+    AVLTree<uint64_t, string> emplaced;
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        emplaced.try_emplace(keys[i], value);
+    }
+    report("avl try_emplace", n, secondsSince(start));
+
+    // Every key is present now: insert overwrites, try_emplace does nothing
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        const pair<const uint64_t, string> item(keys[i], value);
+        copied.insert(item);
+    }
+    report("avl insert copy (present)", n, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        emplaced.try_emplace(keys[i], value);
+    }
+    report("avl try_emplace (present)", n, secondsSince(start));
+}
+
+// Percentile queries: the k-th smallest key and the number of keys below
+// a key, by walking the iterator from begin() versus select/rank.
+static void benchOrderStat(size_t n, size_t walks)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 7);
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < n; ++i) items.push_back(make_pair(keys[i], keys[i]));
+    AVLTree<uint64_t, uint64_t> tree(items.begin(), items.end());
+
+    mt19937_64 rng(8);
+    vector<size_t> ks(n);
+    for(size_t i = 0; i < n; ++i) ks[i] = rng() % n;
+
+    // Walking is O(n) per query, so only time a few of them
+    uint64_t sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < walks; ++i) {
+        AVLTree<uint64_t, uint64_t>::iterator it = tree.begin();
+        for(size_t j = 0; j < ks[i]; ++j) ++it;
+        sum += it->first;
+    }
+    report("avl k-th by iterating", walks, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        sum += tree.select(ks[i])->first;
+    }
+    report("avl select", n, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        sum += tree.rank(keys[ks[i]]);
+    }
+    report("avl rank", n, secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// Visit the keys of random ranges of span keys, skipping forward from
+// begin() versus starting at lower_bound through range(); then one full
+// descending scan from end().
+static void benchRange(size_t n, size_t span, size_t skips, size_t queries)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 11);
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < n; ++i) items.push_back(make_pair(keys[i], keys[i]));
+    AVLTree<uint64_t, uint64_t> tree(items.begin(), items.end());
+
+    mt19937_64 rng(12);
+    vector<uint64_t> los(queries);
+    for(size_t i = 0; i < queries; ++i) los[i] = rng() % (2 * (n - span));
+
+    // Skipping is O(n) per query, so only time a few of them
+    uint64_t sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < skips; ++i) {
+        AVLTree<uint64_t, uint64_t>::iterator it = tree.begin();
+        while(it != tree.end() && it->first < los[i]) ++it;
+        for(; it != tree.end() && it->first < los[i] + 2 * span; ++it) sum += it->second;
+    }
+    report("avl skip from begin", skips, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < queries; ++i) {
+        for(const pair<const uint64_t, uint64_t>& item : tree.range(los[i], los[i] + 2 * span)) {
+            sum += item.second;
+        }
+    }
+    report("avl range", queries, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    AVLTree<uint64_t, uint64_t>::iterator it = tree.end();
+    for(size_t i = 0; i < n; ++i) sum += (--it)->first;
+    report("avl descending scan", n, secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// Sum the values of random key ranges of about span keys by iterating
+// over each range versus with rangeAggregate.
+static void benchRangeAggregate(size_t n, size_t span, size_t queries)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 9);
+    vector<pair<uint64_t, uint64_t> > items;
+    for(size_t i = 0; i < n; ++i) items.push_back(make_pair(keys[i], keys[i]));
+    typedef AugmentedAVLTree<uint64_t, uint64_t, SumMonoid<uint64_t> > Tree;
+    Tree tree(items.begin(), items.end());
+
+    // Keys are the odd numbers below 2n, so lo is always in the tree
+    mt19937_64 rng(10);
+    vector<uint64_t> los(queries);
+    for(size_t i = 0; i < queries; ++i) los[i] = (rng() % (n - span)) * 2 + 1;
+
+    string label = "span=" + to_string(span);
+    uint64_t sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < queries; ++i) {
+        uint64_t hi = los[i] + 2 * span;
+        for(Tree::iterator it = tree.find(los[i]);
+            it != tree.end() && it->first < hi; ++it) {
+            sum += it->second;
+        }
+    }
+    report("avl iterate range " + label, queries, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t i = 0; i < queries; ++i) {
+        sum += tree.rangeAggregate(los[i], los[i] + 2 * span);
+    }
+    report("avl rangeAggregate " + label, queries, secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// Scan every key from begin() to end(), first climbing parent pointers
+// and then with successor threads. The keys go in in random order, so
+// neighbouring keys are scattered through memory, as in a long-lived tree.
+template<typename Tree>
+static void benchScan(const string& name, const vector<uint64_t>& keys, size_t passes)
+{
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+
+    uint64_t sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t p = 0; p < passes; ++p) {
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) sum += it->second;
+    }
+    report(name + " scan", passes * keys.size(), secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    tree.setThreaded(true);
+    report(name + " setThreaded", keys.size(), secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for(size_t p = 0; p < passes; ++p) {
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) sum += it->second;
+    }
+    report(name + " threaded scan", passes * keys.size(), secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// AVLTree behind one mutex, the usual way to share a map between threads,
+// with the lookup interface of ConcurrentAVLTree.
+class LockedAVLTree
+{
+public:
+    bool find(uint64_t key, uint64_t& value) const
+    {
+        lock_guard<mutex> guard(lock_);
+        AVLTree<uint64_t, uint64_t>::iterator it = tree_.find(key);
+        if(it == tree_.end()) return false;
+        value = it->second;
+        return true;
+    }
+    void insert(const pair<const uint64_t, uint64_t>& item)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.insert(item);
+    }
+    void remove(uint64_t key)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.remove(key);
+    }
+
+private:
+    mutable mutex lock_;
+    AVLTree<uint64_t, uint64_t> tree_;
+};
+
+// reads lookups spread over the given number of reader threads, while two
+// writer threads insert and remove other keys for as long as they run.
+// The readers only look up keys that are never removed, so every lookup
+// has to succeed; a miss would mean a reader lost its way.
+template<typename Map>
+static void benchReadersWriters(const string& name, const vector<uint64_t>& keys, size_t readers,
+    size_t reads)
+{
+    Map map;
+    for(size_t i = 0; i < keys.size(); ++i) map.insert(make_pair(keys[i], keys[i]));
+
+    atomic<bool> done(false);
+    atomic<size_t> writes(0), misses(0);
+    vector<thread> writers;
+    for(size_t w = 0; w < 2; ++w) {
+        writers.push_back(thread([&, w]() {
+            mt19937_64 rng(15 + w);
+            while(!done.load()) {
+                // Even keys, which the readers never look for
+                uint64_t key = (rng() % keys.size()) * 2;
+                if(rng() % 2) map.insert(make_pair(key, key));
+                else map.remove(key);
+                writes.fetch_add(1, memory_order_relaxed);
+            }
+        }));
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for(size_t r = 0; r < readers; ++r) {
+        threads.push_back(thread([&, r]() {
+            size_t missed = 0;
+            uint64_t value;
+            for(size_t i = r; i < reads; i += readers) {
+                uint64_t key = keys[(i * 7919) % keys.size()];
+                if(!map.find(key, value) || value != key) ++missed;
+            }
+            misses.fetch_add(missed);
+        }));
+    }
+    for(size_t r = 0; r < readers; ++r) threads[r].join();
+    double secs = secondsSince(start);
+    done.store(true);
+    for(size_t w = 0; w < writers.size(); ++w) writers[w].join();
+
+    string label = name + " " + to_string(readers) + " readers";
+    report(label, reads, secs);
+    report(label + " (writes)", writes.load(), secs);
+    if(misses.load() != 0) cout << "  " << misses.load() << " lookups missed!" << endl;
+}
+
+// Insert n keys into a persistent tree that shares nothing, then again
+// while a snapshot is taken every `every` inserts (and the previous one
+// dropped), next to AVLTree; then time snapshot() itself.
+static void benchPersistent(size_t n)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 16);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for(size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], keys[i]));
+        report("avl insert", n, secondsSince(start));
+    }
+
+    size_t everies[] = { 0, 1000, 1 };
+    for(size_t e = 0; e < sizeof(everies) / sizeof(everies[0]); ++e) {
+        size_t every = everies[e];
+        start = chrono::steady_clock::now();
+        PersistentAVLTree<uint64_t, uint64_t> tree;
+        PersistentAVLTree<uint64_t, uint64_t> snapshot;
+        for(size_t i = 0; i < n; ++i) {
+            if(every != 0 && i % every == 0) snapshot = tree.snapshot();
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        string label = every == 0 ? "" : " snap/" + to_string(every);
+        report("persistent insert" + label, n, secondsSince(start));
+    }
+
+    PersistentAVLTree<uint64_t, uint64_t> tree;
+    for(size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], keys[i]));
+    start = chrono::steady_clock::now();
+    size_t total = 0;
+    for(size_t i = 0; i < n; ++i) total += tree.snapshot().size();
+    report("persistent snapshot", n, secondsSince(start));
+    if(total == 42) cout << "";
+}
+
+// Insert keys into an AVLTree one at a time and report the rate along
+// with how far each insert climbed and how many rotations it made.
+static void benchRetrace(const string& name, const vector<uint64_t>& keys)
+{
+    AVLTree<uint64_t, uint64_t> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+    report(name + " insert", keys.size(), secondsSince(start));
+
+    const AVLTree<uint64_t, uint64_t>::InsertStats& stats = tree.insertStats();
+    double inserts = stats.inserts == 0 ? 1 : double(stats.inserts);
+    cout << "  " << fixed << setprecision(3) << stats.retraceSteps / inserts << " levels climbed, "
+         << stats.rotations / inserts << " rotations per insert" << endl;
+}
+
+// ops inserts and removes of random keys, split evenly over the given
+// number of writer threads, on a map that starts with every key.
+template<typename Map>
+static void benchWriters(const string& name, const vector<uint64_t>& keys, size_t writers, size_t ops)
+{
+    Map map;
+    for(size_t i = 0; i < keys.size(); ++i) map.insert(make_pair(keys[i], keys[i]));
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for(size_t w = 0; w < writers; ++w) {
+        threads.push_back(thread([&, w]() {
+            mt19937_64 rng(19 + w);
+            for(size_t i = w; i < ops; i += writers) {
+                uint64_t key = keys[rng() % keys.size()];
+                if(rng() % 2) map.insert(make_pair(key, key));
+                else map.remove(key);
+            }
+        }));
+    }
+    for(size_t w = 0; w < writers; ++w) threads[w].join();
+    report(name + " " + to_string(writers) + " writers", ops, secondsSince(start));
+}
+
+// Remove every key of a full ConcurrentAVLTree as fast as one writer can
+// while the given number of readers look keys up, sampling how many
+// removed nodes and values are waiting for readers to move on.
+static void benchReclaim(size_t n, size_t readers)
+{
+    vector<uint64_t> keys = shuffledKeys(n, 17);
+    ConcurrentAVLTree<uint64_t, uint64_t> tree;
+    for(size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], keys[i]));
+
+    atomic<bool> done(false);
+    atomic<size_t> reads(0);
+    vector<thread> threads;
+    for(size_t r = 0; r < readers; ++r) {
+        threads.push_back(thread([&, r]() {
+            mt19937_64 rng(18 + r);
+            size_t count = 0;
+            uint64_t value;
+            while(!done.load(memory_order_relaxed)) {
+                if(tree.find(keys[rng() % n], value) && value == 42) cout << "";
+                ++count;
+            }
+            reads.fetch_add(count);
+        }));
+    }
+
+    size_t peak = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        tree.remove(keys[i]);
+        if(i % 1024 == 0) peak = max(peak, tree.retired());
+    }
+    double secs = secondsSince(start);
+    done.store(true);
+    for(size_t r = 0; r < readers; ++r) threads[r].join();
+
+    string label = "remove, " + to_string(readers) + " readers";
+    report(label, n, secs);
+    if(readers != 0) report(label + " (reads)", reads.load(), secs);
+    cout << "  retired: peak " << peak << ", at end " << tree.retired();
+    tree.reclaim();
+    tree.reclaim();
+    cout << ", after reclaim " << tree.retired() << endl;
+}
+
+// n lookups over keys, the i-th most popular of which is drawn with
+// weight 1 / (i + 1)^s. With drift the ranking moves on by 1% of the
+// keys every tenth of the trace, so the hot set changes as it runs.
+// hotShare is the part of the lookups that go to the top 1% of keys.
+static vector<uint64_t> zipfTrace(const vector<uint64_t>& keys, size_t n, double s, bool drift, uint64_t seed,
+    double& hotShare)
+{
+    vector<double> cdf(keys.size());
+    double total = 0;
+    for(size_t i = 0; i < keys.size(); ++i) cdf[i] = total += pow(double(i + 1), -s);
+    hotShare = cdf[max<size_t>(1, keys.size() / 100) - 1] / total;
+
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> uniform(0, total);
+    size_t phase = max<size_t>(1, n / 10), shift = max<size_t>(1, keys.size() / 100);
+    vector<uint64_t> trace(n);
+    for(size_t i = 0; i < n; ++i) {
+        size_t rank = min<size_t>(lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin(), keys.size() - 1);
+        if(drift) rank = (rank + i / phase * shift) % keys.size();
+        trace[i] = keys[rank];
+    }
+    return trace;
+}
+
+// Time find on every key of trace.
+template<typename Tree>
+static void benchLookups(const string& name, Tree& tree, const vector<uint64_t>& trace)
+{
+    uint64_t sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < trace.size(); ++i) sum += tree.find(trace[i])->second;
+    report(name, trace.size(), secondsSince(start));
+    if(sum == 42) cout << "";
+}
+
+// AVLTree::find against the splay tree's variants on one trace, each
+// tree built by inserting keys in their (random) order.
+static void benchSplay(const string& label, const vector<uint64_t>& keys, const vector<uint64_t>& trace)
+{
+    AVLTree<uint64_t, uint64_t> avl;
+    for(size_t i = 0; i < keys.size(); ++i) avl.insert(make_pair(keys[i], keys[i]));
+    benchLookups(label + " avl", avl, trace);
+
+    struct Variant { const char* name; bool semi; unsigned interval; };
+    const Variant variants[] = {
+        { " splay", false, 1 }, { " semi-splay", true, 1 },
+        { " splay every 4th", false, 4 }, { " splay every 16th", false, 16 }
+    };
+    for(size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v) {
+        SplayTree<uint64_t, uint64_t> tree;
+        tree.setSemiSplay(variants[v].semi);
+        tree.setSplayInterval(variants[v].interval);
+        for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+        tree.resetSplayStats();
+        benchLookups(label + variants[v].name, tree, trace);
+        cout << "  " << fixed << setprecision(2)
+             << double(tree.splayStats().rotations) / tree.splayStats().finds << " rotations per find" << endl;
+    }
+}
+
+// AVLTree::find on one trace with lookup caches of several sizes, 0
+// being no cache.
+static void benchLookupCache(const string& label, const vector<uint64_t>& keys, const vector<uint64_t>& trace)
+{
+    AVLTree<uint64_t, uint64_t> tree;
+    for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], keys[i]));
+    size_t slots[] = { 0, 1024, 4096, 16384, 65536 };
+    for(size_t s = 0; s < sizeof(slots) / sizeof(slots[0]); ++s) {
+        tree.setLookupCache(slots[s]);
+        tree.resetLookupCacheStats();
+        benchLookups(label + " avl, cache " + to_string(slots[s]), tree, trace);
+        const AVLTree<uint64_t, uint64_t>::LookupCacheStats& stats = tree.lookupCacheStats();
+        if(slots[s] != 0) {
+            cout << "  " << fixed << setprecision(1) << 100.0 * stats.hits / (stats.hits + stats.misses)
+                 << "% hits" << endl;
+        }
+    }
+}
+
+static void usage()
+{
+    cout << "usage: bst-bench <suite> [n]" << endl;
+    cout << "suites: insert-find clear bulk-load batch set-ops btree frozen emplace order-stat range range-agg scan concurrent persistent reclaim sharded retrace erase engines splay lookup-cache" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        usage();
+        return 1;
+    }
+    string suite = argv[1];
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+
+    if(suite == "insert-find") {
+        vector<uint64_t> keys = shuffledKeys(n, 1);
+        benchInsertFind<BinarySearchTree<uint64_t, uint64_t> >("bst", keys);
+        benchInsertFind<AVLTree<uint64_t, uint64_t> >("avl", keys);
+    }
+    else if(suite == "clear") {
+        vector<uint64_t> random = shuffledKeys(n, 1);
+        vector<uint64_t> sorted(random);
+        sort(sorted.begin(), sorted.end());
+        string value(32, 'v');
+        benchClear<AVLTree<uint64_t, uint64_t> >("avl<u64> random", random, uint64_t(1));
+        benchClear<AVLTree<uint64_t, uint64_t> >("avl<u64> sorted", sorted, uint64_t(1));
+        benchClear<AVLTree<uint64_t, string> >("avl<string> random", random, value);
+        benchClear<AVLTree<uint64_t, string> >("avl<string> sorted", sorted, value);
+
+        // An unbalanced tree fed sorted keys is a list; building it is
+        // quadratic, so keep it small enough to finish
+        sorted.resize(min<size_t>(n, 20000));
+        benchClear<BinarySearchTree<uint64_t, string> >("bst<string> sorted chain", sorted, value);
+    }
+    else if(suite == "bulk-load") {
+        benchBulkLoad(n);
+    }
+    else if(suite == "batch") {
+        benchBatch(n, n / 100);
+        benchBatch(n, n / 10);
+    }
+    else if(suite == "set-ops") {
+        benchSetOps(n);
+    }
+    else if(suite == "frozen") {
+        benchFrozen(n);
+    }
+    else if(suite == "emplace") {
+        benchEmplace(n);
+    }
+    else if(suite == "order-stat") {
+        benchOrderStat(n, 100);
+    }
+    else if(suite == "range") {
+        benchRange(n, 100, 100, 100000);
+    }
+    else if(suite == "range-agg") {
+        benchRangeAggregate(n, 100, 100000);
+        benchRangeAggregate(n, n / 10, 1000);
+    }
+    else if(suite == "scan") {
+        // Sized for deep trees whose nodes do not fit in cache
+        vector<uint64_t> keys = shuffledKeys(argc > 2 ? n : 10000000, 13);
+        benchScan<BinarySearchTree<uint64_t, uint64_t> >("bst", keys, max<size_t>(3, 30000000 / keys.size()));
+        benchScan<AVLTree<uint64_t, uint64_t> >("avl", keys, max<size_t>(3, 30000000 / keys.size()));
+    }
+    else if(suite == "concurrent") {
+        vector<uint64_t> keys = shuffledKeys(n, 14);
+        size_t threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+        for(size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+            benchReadersWriters<LockedAVLTree>("locked", keys, threads[i], 2 * n);
+            benchReadersWriters<ConcurrentAVLTree<uint64_t, uint64_t> >("concurrent", keys, threads[i], 2 * n);
+        }
+    }
+    else if(suite == "persistent") {
+        benchPersistent(n);
+    }
+    else if(suite == "reclaim") {
+        size_t readers[] = { 0, 1, 4 };
+        for(size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); ++i) benchReclaim(n, readers[i]);
+    }
+    else if(suite == "sharded") {
+        vector<uint64_t> keys = shuffledKeys(n, 20);
+        size_t threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+        for(size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+            benchWriters<LockedAVLTree>("locked", keys, threads[i], n);
+            benchWriters<ShardedMap<uint64_t, uint64_t, 64> >("sharded/64", keys, threads[i], n);
+        }
+
+        vector<pair<uint64_t, uint64_t> > items;
+        for(size_t i = 0; i < n; ++i) items.push_back(make_pair(keys[i], keys[i]));
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        {
+            AVLTree<uint64_t, uint64_t> tree;
+            tree.bulkLoad(items.begin(), items.end());
+            report("avl bulk-load", n, secondsSince(start));
+        }
+        start = chrono::steady_clock::now();
+        ShardedMap<uint64_t, uint64_t, 64> map;
+        map.bulkLoad(items.begin(), items.end());
+        report("sharded/64 bulk-load", n, secondsSince(start));
+
+        start = chrono::steady_clock::now();
+        uint64_t sum = 0;
+        for(ShardedMap<uint64_t, uint64_t, 64>::iterator it = map.begin(); it != map.end(); ++it) sum += it->second;
+        report("sharded/64 merged scan", n, secondsSince(start));
+        if(sum == 42) cout << "";
+    }
+    else if(suite == "retrace") {
+        vector<uint64_t> keys = shuffledKeys(n, 21);
+        benchRetrace("random", keys);
+        sort(keys.begin(), keys.end());
+        benchRetrace("ascending", keys);
+        // Runs of 64 ascending keys, the runs in random order
+        vector<uint64_t> starts = shuffledKeys((n + 63) / 64, 22);
+        for(size_t i = 0; i < n; ++i) keys[i] = starts[i / 64] * 64 + i % 64;
+        benchRetrace("runs of 64", keys);
+    }
+    else if(suite == "erase") {
+        vector<uint64_t> keys = shuffledKeys(n, 23);
+        benchRemove<BinarySearchTree<uint64_t, uint64_t> >("bst", keys);
+        benchRemove<AVLTree<uint64_t, uint64_t> >("avl", keys);
+        benchErase<BinarySearchTree<uint64_t, uint64_t> >("bst", keys);
+        benchErase<AVLTree<uint64_t, uint64_t> >("avl", keys);
+    }
+    else if(suite == "engines") {
+        // Keys from [0, 2n): shuffledKeys gives the odd half as a start
+        vector<uint64_t> none, half = shuffledKeys(n / 2, 24), full = shuffledKeys(n, 25);
+        benchEngines("insert-heavy", none, makeOps(n, 90, 10, 26));
+        benchEngines("delete-heavy", full, makeOps(n, 10, 90, 27));
+        benchEngines("mixed", half, makeOps(n, 25, 25, 28));
+        benchEngines("read-mostly", full, makeOps(n, 5, 5, 29));
+    }
+    else if(suite == "splay") {
+        vector<uint64_t> keys = shuffledKeys(n, 30);
+        double hot;
+        const char* names[] = { "uniform", "zipf", "zipf drifting" };
+        double exponents[] = { 0, 1.1, 1.1 };
+        for(size_t t = 0; t < 3; ++t) {
+            vector<uint64_t> trace = zipfTrace(keys, 2 * n, exponents[t], t == 2, 31 + t, hot);
+            cout << names[t] << ": top 1% of keys take " << fixed << setprecision(1) << 100 * hot
+                 << "% of lookups" << endl;
+            benchSplay(names[t], keys, trace);
+        }
+    }
+    else if(suite == "lookup-cache") {
+        vector<uint64_t> keys = shuffledKeys(n, 34);
+        double hot;
+        const char* names[] = { "uniform", "zipf", "zipf drifting" };
+        double exponents[] = { 0, 1.1, 1.1 };
+        for(size_t t = 0; t < 3; ++t) {
+            vector<uint64_t> trace = zipfTrace(keys, 2 * n, exponents[t], t == 2, 35 + t, hot);
+            cout << names[t] << ": top 1% of keys take " << fixed << setprecision(1) << 100 * hot
+                 << "% of lookups" << endl;
+            benchLookupCache(names[t], keys, trace);
+        }
+    }
+    else if(suite == "btree") {
+        vector<uint64_t> keys = shuffledKeys(n, 1);
+        benchInsertFind<AVLTree<uint64_t, uint64_t> >("avl", keys);
+        benchInsertFind<BTree<uint64_t, uint64_t> >("btree", keys);
+        benchInsertFind<BTree<OpaqueKey, uint64_t> >("btree binary-search", keys);
+        benchRemove<AVLTree<uint64_t, uint64_t> >("avl", keys);
+        benchRemove<BTree<uint64_t, uint64_t> >("btree", keys);
+    }
+    else {
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -6,20 +6,32 @@
 #include <cstdlib>
 #include <utility>
 #include <functional>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include "frozen_map.h"
+#include "node_pool.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual, so nodes carry no vtable pointer and
+ * every traversal step is a plain load. Trees that keep balance
+ * data in their nodes, such as Red Black trees and AVL trees,
+ * derive from Node and hide the getters with versions returning
+ * their own node type (see AVLNode in avlbst.h); the tree that
+ * owns the nodes is responsible for destroying them as that type.
+ * Trees that need no such data, such as SplayTree (splaybst.h),
+ * use Node as it is.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -27,20 +39,27 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+    // In-order successor threads, kept in the right slot of a node with no right child
+    Node<Key, Value>* getSuccessorThread() const;
+    void setSuccessorThread(Node<Key, Value>* next);
+
 protected:
+    // Nodes are at least pointer aligned, so the low bit of a real child is always 0
+    static const uintptr_t THREAD_TAG = 1;
+
     std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
-    Node<Key, Value>* right_;
+    Node<Key, Value>* right_;   // the right child, or a successor thread tagged with THREAD_TAG
 };
 
 /*
@@ -62,6 +81,19 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -119,7 +151,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -128,7 +160,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -137,12 +169,13 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child. A successor thread in the right slot
+* is not a child, so it reads as NULL.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
 {
-    return right_;
+    return (reinterpret_cast<uintptr_t>(right_) & THREAD_TAG) ? NULL : right_;
 }
 
 /**
@@ -172,6 +205,28 @@ void Node<Key, Value>::setRight(Node<Key, Value>* right)
     right_ = right;
 }
 
+/**
+* Returns the in-order successor this node is threaded to, or NULL if
+* the right slot holds a real child or nothing at all.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::getSuccessorThread() const
+{
+    uintptr_t bits = reinterpret_cast<uintptr_t>(right_);
+    return (bits & THREAD_TAG) ? reinterpret_cast<Node<Key, Value>*>(bits & ~THREAD_TAG) : NULL;
+}
+
+/**
+* Threads a node with no right child to its in-order successor, or
+* clears the thread when next is NULL (as for the largest node).
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setSuccessorThread(Node<Key, Value>* next)
+{
+    right_ = next == NULL ? NULL
+        : reinterpret_cast<Node<Key, Value>*>(reinterpret_cast<uintptr_t>(next) | THREAD_TAG);
+}
+
 /**
 * A setter for the value of a node.
 */
@@ -187,24 +242,69 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* Hashes keys for the lookup cache of BinarySearchTree with std::hash.
+* Keys that have no std::hash get this version, and their trees simply
+* never turn the cache on.
+*/
+template<typename Key, typename = void>
+struct LookupCacheHash
+{
+    static const bool enabled = false;
+    static std::size_t hash(const Key&) { return 0; }
+};
+
+template<typename Key>
+struct LookupCacheHash<Key, decltype(void(std::hash<Key>()(std::declval<const Key&>())))>
+{
+    static const bool enabled = true;
+    static std::size_t hash(const Key& key) { return std::hash<Key>()(key); }
+};
+
 /**
 * A templated unbalanced binary search tree.
+* Keys are ordered by Compare, as in std::map. If Compare declares
+* is_transparent, find and operator[] also accept any type that it can
+* compare against Key, so e.g. a tree of std::string can be searched
+* with a const char* without building a temporary string.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp);
+    template<typename InputIterator>
+    BinarySearchTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    void insert(std::pair<const Key, Value>&& keyValuePair);
     virtual void remove(const Key& key); //TODO
+    template<typename InputIterator>
+    void bulkLoad(InputIterator first, InputIterator last);
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    FrozenMap<Key, Value, Compare> freeze() const;
     void print() const;
     bool empty() const;
+    Compare key_comp() const;
+    void setThreaded(bool threaded);
+    bool threaded() const;
+
+    // A direct-mapped cache of recently found nodes in front of the
+    // non-const find and operator[], off unless given a size
+    struct LookupCacheStats
+    {
+        uint64_t hits;          // lookups answered from the cache
+        uint64_t misses;        // lookups that searched the tree
+    };
+    void setLookupCache(std::size_t slots);
+    std::size_t lookupCacheSize() const;
+    const LookupCacheStats& lookupCacheStats() const;
+    void resetLookupCacheStats();
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -221,25 +321,78 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator& operator--();
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare>* tree_;    // lets --end() find the last node
+    };
+
+    /**
+    * The keys in a half-open interval [lo, hi), as returned by range(),
+    * for use in a range-based for loop.
+    */
+    class Range
+    {
+    public:
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare>;
+        Range(iterator first, iterator last);
+        iterator first_;
+        iterator last_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator find(const Key& key);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    // Ordered searches: each descends once, then iterators stream from there
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    iterator erase(iterator pos);
+
+    // Insertion that moves or constructs the key and value instead of copying them
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj);
+
+    // Heterogeneous lookups, only for a transparent Compare
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value& operator[](const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value const & operator[](const K& key) const;
+
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    iterator iteratorAt(Node<Key, Value>* node) const;
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
@@ -248,11 +401,46 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
-
+    BinarySearchTree(std::size_t nodeSize, const Compare& comp);
+    template<typename NodeType, typename K, typename V>
+    NodeType* createNode(K&& key, V&& value, NodeType* parent);
+    template<typename K>
+    Node<Key, Value>* findSlot(const K& key, Node<Key, Value>*& parent, bool& goLeft) const;
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual void valueChanged(Node<Key, Value>* node);
+    virtual bool trivialNodes() const;
+    virtual void destroyNode(Node<Key, Value>* node);
+    void destroySubtree(Node<Key, Value>* node);
+    Node<Key, Value>* takeNodes(std::shared_ptr<NodePool>& storage);
+    void sortUniqueItems(std::vector<std::pair<Key, Value> >& items) const;
+    virtual Node<Key, Value>* buildBalanced(std::vector<std::pair<Key, Value> >& items,
+        std::size_t lo, std::size_t hi, Node<Key, Value>* parent);
+    virtual void removeNode(Node<Key, Value>* node);
+    void rotateLeft(Node<Key, Value>* x);
+    void rotateRight(Node<Key, Value>* x);
+    void rethread();
+    void threadPast(Node<Key, Value>* removed);
+    Node<Key, Value>* cachedFind(const Key& key);
+    std::size_t cacheSlotOf(const Key& key) const;
+    void uncache(Node<Key, Value>* removed);
+    void flushLookupCache();
+
+    // One entry of the lookup cache; referenced gives the node a second
+    // chance when a miss would evict it
+    struct CacheSlot
+    {
+        Node<Key, Value>* node;
+        bool referenced;
+    };
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    std::shared_ptr<NodePool> pool_;    // backing storage for every node in this tree
+    Compare comp_;
+    bool threaded_;                     // keep successor threads in empty right slots
+    std::vector<CacheSlot> cache_;      // empty while the lookup cache is off
+    LookupCacheStats cacheStats_;
 };
 
 /*
@@ -264,29 +452,32 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr,
+    const BinarySearchTree<Key, Value, Compare>* tree)
 {
     // TODO
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     // TODO
     current_ = nullptr;
+    tree_ = nullptr;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -294,9 +485,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -305,10 +496,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return this->current_ == rhs.current_;
@@ -318,10 +509,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return this->current_ != rhs.current_;
@@ -332,12 +523,19 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
     if (current_ == nullptr) return *this;
 
+    // A threaded tree names the successor directly: one load, no climbing
+    Node<Key, Value>* next = current_->getSuccessorThread();
+    if (next != nullptr) {
+        current_ = next;
+        return *this;
+    }
+
     // Case 1: Right subtree exists
     if (current_->getRight() != nullptr) {
         current_ = current_->getRight();
@@ -358,6 +556,26 @@ BinarySearchTree<Key, Value>::iterator::operator++()
     return *this;
 }
 
+/**
+* Moves the iterator back to the previous key in order. Decrementing
+* end() reaches the largest key, so a descending scan can start there;
+* decrementing the iterator at the smallest key gives end().
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (current_ == nullptr) 
+    {
+        current_ = tree_ != nullptr ? tree_->getLargestNode() : nullptr;
+    }
+    else 
+    {
+        current_ = predecessor(current_);
+    }
+    return *this;
+}
+
 
 
 /*
@@ -366,6 +584,58 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-----------------------------------------------------------
+Begin implementations for the BinarySearchTree::Range class.
+-----------------------------------------------------------
+*/
+
+/**
+* A range from first up to (but not including) last.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::Range::Range(iterator first, iterator last) :
+    first_(first),
+    last_(last)
+{
+
+}
+
+/**
+* Returns an iterator to the first key in the range.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Range::begin() const
+{
+    return first_;
+}
+
+/**
+* Returns an iterator just past the last key in the range.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Range::end() const
+{
+    return last_;
+}
+
+/**
+* Returns true if no key falls in the range.
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::Range::empty() const
+{
+    return first_ == last_;
+}
+
+/*
+---------------------------------------------------------
+End implementations for the BinarySearchTree::Range class.
+---------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -375,15 +645,65 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree() :
+    root_(nullptr),
+    pool_(std::make_shared<NodePool>(sizeof(Node<Key, Value>))),
+    comp_(),
+    threaded_(false),
+    cacheStats_()
 {
-    // TODO
-    root_ = nullptr;
+
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    root_(nullptr),
+    pool_(std::make_shared<NodePool>(sizeof(Node<Key, Value>))),
+    comp_(comp),
+    threaded_(false),
+    cacheStats_()
+{
+
+}
+
+/**
+* Constructor for derived trees whose nodes are larger than a plain Node,
+* so that the node pool hands out slots of the right size.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t nodeSize, const Compare& comp) :
+    root_(nullptr),
+    pool_(std::make_shared<NodePool>(nodeSize)),
+    comp_(comp),
+    threaded_(false),
+    cacheStats_()
+{
+
+}
+
+/**
+* Range constructor; builds a balanced tree from [first, last).
+* See bulkLoad.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(InputIterator first, InputIterator last,
+    const Compare& comp) :
+    root_(nullptr),
+    pool_(std::make_shared<NodePool>(sizeof(Node<Key, Value>))),
+    comp_(comp),
+    threaded_(false),
+    cacheStats_()
+{
+    bulkLoad(first, last);
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
 {
     // TODO
     clear();
@@ -392,14 +712,103 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Returns a copy of the comparator that orders the keys.
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Turns successor threads on or off, in O(n). A threaded tree stores the
+* in-order successor of every node that has no right child in that
+* node's empty right slot, so iterator::operator++ moves there with one
+* load instead of climbing parent pointers. Single-key inserts, removes
+* and rotations keep the threads up to date in O(1) extra work; bulk
+* operations (bulkLoad, and the batch, split, join and set operations of
+* AVLTree) rethread their results in O(n).
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::setThreaded(bool threaded)
+{
+    threaded_ = threaded;
+    rethread();
+}
+
+/**
+* Returns true if the tree keeps successor threads.
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::threaded() const
+{
+    return threaded_;
+}
+
+/**
+* Puts a cache of key -> node with the given number of slots (rounded
+* up to a power of two) in front of find and operator[], or takes it
+* away if slots is 0. A key's node stays the same for as long as the key
+* is in the tree, since rotations and nodeSwap move nodes rather than
+* keys, so only removing nodes invalidates entries. A hit costs a hash
+* and one comparison instead of a descent. Only lookups through a
+* non-const tree use the cache, since they write to it; const lookups
+* are plain searches that write nothing, so several threads can still
+* make them at once. Heterogeneous lookups, and trees that search in
+* their own way (SplayTree), bypass the cache, and so do keys without
+* std::hash.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::setLookupCache(std::size_t slots)
+{
+    std::size_t size = 0;
+    if (slots != 0 && LookupCacheHash<Key>::enabled)
+    {
+        size = 1;
+        while (size < slots) size <<= 1;
+    }
+    CacheSlot empty = { nullptr, false };
+    cache_.assign(size, empty);
+    cache_.shrink_to_fit();
+}
+
+/**
+* Returns the number of slots in the lookup cache, 0 if it is off.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::lookupCacheSize() const
+{
+    return cache_.size();
+}
+
+/**
+* Returns how many lookups the cache answered and how many it did not.
+*/
+template<class Key, class Value, class Compare>
+const typename BinarySearchTree<Key, Value, Compare>::LookupCacheStats&
+BinarySearchTree<Key, Value, Compare>::lookupCacheStats() const
+{
+    return cacheStats_;
+}
+
+/**
+* Zeroes the lookup cache counters.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::resetLookupCacheStats()
+{
+    cacheStats_ = LookupCacheStats();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -408,22 +817,22 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Compare>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL, this);
     return end;
 }
 
@@ -431,12 +840,24 @@ BinarySearchTree<Key, Value>::end() const
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
 {
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Non-const find, which goes through the lookup cache if it is on.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k)
+{
+    Node<Key, Value> *curr = cachedFind(k);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
     return it;
 }
 
@@ -444,15 +865,15 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
 {
-    Node<Key, Value> *curr = internalFind(key);
+    Node<Key, Value> *curr = cachedFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
@@ -460,182 +881,924 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Heterogeneous find: like find(const Key&), but for any key type the
+* transparent comparator can compare with Key, without converting it.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& key) const
 {
-    Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-    
-    if (root_ == nullptr) 
-    {  
-        // If tree is empty
-        root_ = newNode;
-    } 
-    else 
-    {
-        Node<Key, Value>* current = root_;
-        Node<Key, Value>* parent = nullptr;
-
-        // Find the correct position
-        while (current != nullptr) 
-        {
-            parent = current;
-            if (keyValuePair.first < current->getKey()) 
-            {
-                current = current->getLeft();
-            } 
-            else if (keyValuePair.first > current->getKey()) 
-            {
-                current = current->getRight();
-            } 
-            else 
-            {
-                current->setValue(keyValuePair.second);  // Overwrite value if key is found
-                delete newNode;  // Avoid memory leak if the key already exists
-                return;
-            }
-        }
-
-        // Insert the new node
-        if (keyValuePair.first < parent->getKey()) 
-        {
-            parent->setLeft(newNode);
-        } 
-        else 
-        {
-            parent->setRight(newNode);
-        }
-        newNode->setParent(parent);
-    }
+    return iterator(internalFind(key), this);
 }
 
-
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Non-const version of the heterogeneous find, so that it is not
+* ambiguous with the non-const find(const Key&). It bypasses the lookup
+* cache like the const one.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& key)
 {
-    Node<Key, Value>* nodeToRemove = internalFind(key);
-
-    if (nodeToRemove == nullptr) return; // Node not found
+    return iterator(internalFind(key), this);
+}
 
-    // Case 1: No children
-    if (nodeToRemove->getLeft() == nullptr && nodeToRemove->getRight() == nullptr) 
+/**
+* Returns an iterator to the first key that is not less than key, or
+* end() if there is none, with one comparison per level.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (current != nullptr) 
     {
-        if (nodeToRemove == root_) 
+        if (comp_(current->getKey(), key)) 
         {
-            root_ = nullptr;
+            current = current->getRight();
         } 
         else 
         {
-            Node<Key, Value>* parent = nodeToRemove->getParent();
-            if (nodeToRemove == parent->getLeft()) 
-            {
-                parent->setLeft(nullptr);
-            } 
-            else 
-            {
-                parent->setRight(nullptr);
-            }
+            bound = current;
+            current = current->getLeft();
         }
-        delete nodeToRemove;
     }
+    return iterator(bound, this);
+}
 
-    // Case 2: One child
-    else if (nodeToRemove->getLeft() == nullptr || nodeToRemove->getRight() == nullptr) 
+/**
+* Returns an iterator to the first key that is greater than key, or
+* end() if there is none, with one comparison per level.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (current != nullptr) 
     {
-        Node<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? nodeToRemove->getLeft() : nodeToRemove->getRight();
-        if (nodeToRemove == root_) 
+        if (comp_(key, current->getKey())) 
         {
-            root_ = child;
+            bound = current;
+            current = current->getLeft();
         } 
         else 
         {
-            Node<Key, Value>* parent = nodeToRemove->getParent();
-            if (nodeToRemove == parent->getLeft()) 
-            {
-                parent->setLeft(child);
-            } 
-            else 
-            {
-                parent->setRight(child);
-            }
+            current = current->getRight();
         }
-        child->setParent(nodeToRemove->getParent());
-        delete nodeToRemove;
-    }
-
-    // Case 3: Two children
-    else 
-    {
-        Node<Key, Value>* predecessorNode = predecessor(nodeToRemove);
-        nodeSwap(nodeToRemove, predecessorNode);
-        remove(nodeToRemove->getKey());
     }
+    return iterator(bound, this);
 }
 
-
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+/**
+* Returns the range of keys equal to key: either just that key, or an
+* empty range at the position where it would go. Keys are unique, so
+* the upper end is the successor of the lower end when it matches,
+* which saves a second descent.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key) const
 {
-    if (current == nullptr) return nullptr;
-
-    // Case 1: If left child exists, go to rightmost node in left subtree
-    if (current->getLeft() != nullptr) 
-    {
-        current = current->getLeft();
-        while (current->getRight() != nullptr) 
-        {
-            current = current->getRight();
-        }
-        return current;
-    }
-
-    // Case 2: Go up until we find a node which is a right child
-    Node<Key, Value>* parent = current->getParent();
-    while (parent != nullptr && current == parent->getLeft()) 
+    iterator first = lower_bound(key);
+    iterator last = first;
+    if (last != end() && !comp_(key, last->first)) 
     {
-        current = parent;
-        parent = parent->getParent();
+        ++last;
     }
-    return parent;
+    return std::make_pair(first, last);
 }
 
-
 /**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* Returns the keys in [lo, hi) as a view to iterate over. Both ends are
+* found with one descent each in O(log n); iterating then streams with
+* operator++. An empty range results if hi is not greater than lo.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::Range
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const
 {
-    // Helper function to recursively delete nodes
-    std::function<void(Node<Key, Value>*)> deleteNode = [&](Node<Key, Value>* node) 
+    if (!comp_(lo, hi)) 
     {
-        if (node == nullptr) return;
-        deleteNode(node->getLeft());
-        deleteNode(node->getRight());
-        delete node;
-    };
-
-    deleteNode(root_);
-    root_ = nullptr;
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
 }
 
-
 /**
-* A helper function to find the smallest node in the tree.
-*/
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const
-{
+ * @precondition The key exists in the map
+ * Heterogeneous version of operator[]; see find(const K&).
+ */
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const K& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const K& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(keyValuePair.first, parent, goLeft);
+    if (found != nullptr) 
+    {
+        found->setValue(keyValuePair.second);
+        valueChanged(found);
+        return;
+    }
+    linkNode(makeNode(Key(keyValuePair.first), Value(keyValuePair.second), parent), parent, goLeft);
+}
+
+/**
+* Like insert(const std::pair&), but moves the value into the tree
+* rather than copying it. The key is const and so still copied, and only
+* when a new node is made.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(keyValuePair.first, parent, goLeft);
+    if (found != nullptr) 
+    {
+        found->getValue() = std::move(keyValuePair.second);
+        valueChanged(found);
+        return;
+    }
+    linkNode(makeNode(Key(keyValuePair.first), std::move(keyValuePair.second), parent), parent, goLeft);
+}
+
+/**
+* Builds a key/value pair from args as std::pair's constructor would and
+* inserts it if its key is not in the tree yet; an existing value is
+* left alone. Since the key is only known once the pair exists, the pair
+* is built up front and then moved into the new node. Returns the
+* position of the key and whether it was inserted.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(item.first, parent, goLeft);
+    if (found != nullptr) 
+    {
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* node = makeNode(std::move(item.first), std::move(item.second), parent);
+    linkNode(node, parent, goLeft);
+    return std::make_pair(iterator(node, this), true);
+}
+
+/**
+* If key is not in the tree, inserts it with a value constructed from
+* args. If it is, nothing happens and args are not touched, so an
+* rvalue passed in is still intact. Returns the position of the key and
+* whether it was inserted.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(key, parent, goLeft);
+    if (found != nullptr) 
+    {
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* node = makeNode(Key(key), Value(std::forward<Args>(args)...), parent);
+    linkNode(node, parent, goLeft);
+    return std::make_pair(iterator(node, this), true);
+}
+
+/**
+* Like try_emplace(const Key&, ...), but moves the key into the new node.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(key, parent, goLeft);
+    if (found != nullptr) 
+    {
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* node = makeNode(std::move(key), Value(std::forward<Args>(args)...), parent);
+    linkNode(node, parent, goLeft);
+    return std::make_pair(iterator(node, this), true);
+}
+
+/**
+* Assigns obj to the value of key if it is in the tree, and otherwise
+* inserts key with a value constructed from obj. Returns the position
+* of the key and whether it was inserted.
+*/
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(const Key& key, M&& obj)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(key, parent, goLeft);
+    if (found != nullptr) 
+    {
+        found->getValue() = std::forward<M>(obj);
+        valueChanged(found);
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* node = makeNode(Key(key), Value(std::forward<M>(obj)), parent);
+    linkNode(node, parent, goLeft);
+    return std::make_pair(iterator(node, this), true);
+}
+
+/**
+* Like insert_or_assign(const Key&, obj), but moves the key into a new node.
+*/
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(Key&& key, M&& obj)
+{
+    Node<Key, Value>* parent;
+    bool goLeft;
+    Node<Key, Value>* found = findSlot(key, parent, goLeft);
+    if (found != nullptr) 
+    {
+        found->getValue() = std::forward<M>(obj);
+        valueChanged(found);
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* node = makeNode(std::move(key), Value(std::forward<M>(obj)), parent);
+    linkNode(node, parent, goLeft);
+    return std::make_pair(iterator(node, this), true);
+}
+
+/**
+* Descends to where key belongs with one comparison per level. Returns
+* the node holding key if there is one. Otherwise returns nullptr, and
+* a new node for key goes below parent (nullptr for an empty tree) on
+* the side given by goLeft. Nothing is allocated on the way down.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findSlot(const K& key, Node<Key, Value>*& parent,
+    bool& goLeft) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* candidate = nullptr;   // last node whose key is <= key
+    parent = nullptr;
+    goLeft = false;
+    while (current != nullptr) 
+    {
+        parent = current;
+        goLeft = comp_(key, current->getKey());
+        if (goLeft) 
+        {
+            current = current->getLeft();
+        } 
+        else 
+        {
+            candidate = current;
+            current = current->getRight();
+        }
+    }
+    if (candidate != nullptr && !comp_(candidate->getKey(), key)) 
+    {
+        return candidate;
+    }
+    return nullptr;
+}
+
+/**
+* Creates the node for a key that is not in the tree yet, moving the
+* key and value into it. Derived trees override this to create their
+* own node type.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::makeNode(Key&& key, Value&& value,
+    Node<Key, Value>* parent)
+{
+    return createNode(std::move(key), std::move(value), parent);
+}
+
+/**
+* Hangs a node from makeNode below parent on the side found by findSlot,
+* or makes it the root. Derived trees override this to rebalance.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    if (threaded_ && parent != nullptr) 
+    {
+        // A new leaf comes just before its parent (if it hangs left) or
+        // takes over the parent's thread (if it hangs right)
+        node->setSuccessorThread(goLeft ? parent : parent->getSuccessorThread());
+    }
+
+    if (parent == nullptr) 
+    {
+        root_ = node;
+    } 
+    else if (goLeft) 
+    {
+        parent->setLeft(node);
+    } 
+    else 
+    {
+        parent->setRight(node);
+    }
+}
+
+
+/**
+* Replaces the contents of the tree with the key/value pairs in
+* [first, last), building a height-balanced tree directly instead of
+* inserting one pair at a time. Input that is already sorted by key is
+* loaded in O(n); anything else is sorted first. As with insert, when a
+* key appears more than once the last value wins.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+void BinarySearchTree<Key, Value, Compare>::bulkLoad(InputIterator first, InputIterator last)
+{
+    std::vector<std::pair<Key, Value> > items(first, last);
+    sortUniqueItems(items);
+
+    clear();
+    if (items.empty()) return;
+    try
+    {
+        root_ = buildBalanced(items, 0, items.size(), nullptr);
+    }
+    catch (...)
+    {
+        // Every node built so far lives in pool_, so clear() finds them all
+        clear();
+        throw;
+    }
+    if (threaded_) rethread();
+}
+
+
+/**
+* Returns an immutable copy of the tree's contents laid out for fast
+* read-only lookups (see FrozenMap), built from one in-order walk in
+* O(n). Later changes to the tree do not affect it.
+*/
+template<class Key, class Value, class Compare>
+FrozenMap<Key, Value, Compare> BinarySearchTree<Key, Value, Compare>::freeze() const
+{
+    return FrozenMap<Key, Value, Compare>(begin(), end(), comp_);
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Node<Key, Value>* nodeToRemove = internalFind(key);
+
+    if (nodeToRemove == nullptr) return; // Node not found
+    removeNode(nodeToRemove);
+}
+
+
+/**
+* Removes the key pos points to and returns an iterator to the one after
+* it. pos already holds the node, so nothing is searched for. Removal
+* moves nodes rather than keys, so iterators to other keys stay valid.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator pos)
+{
+    Node<Key, Value>* nodeToRemove = pos.current_;
+    ++pos;
+    removeNode(nodeToRemove);
+    return pos;
+}
+
+
+/**
+* Unlinks a node of this tree and destroys it. A node with two children
+* first swaps places with its predecessor, which leaves it with at most
+* a left child, and is then unlinked from where it ended up. (Searching
+* for its key again would not work: the predecessor now sits above it,
+* and the search would go right of it.)
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeNode(Node<Key, Value>* nodeToRemove)
+{
+    // Two children: trade places with the predecessor
+    if (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr)
+    {
+        Node<Key, Value>* predecessorNode = predecessor(nodeToRemove);
+        nodeSwap(nodeToRemove, predecessorNode);
+        // The swap left nodeToRemove with no right child, just before predecessorNode
+        if (threaded_) nodeToRemove->setSuccessorThread(predecessorNode);
+    }
+
+    // Now at most one child, which takes the node's place
+    Node<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? nodeToRemove->getLeft() : nodeToRemove->getRight();
+    Node<Key, Value>* parent = nodeToRemove->getParent();
+    if (parent == nullptr)
+    {
+        root_ = child;
+    }
+    else if (nodeToRemove == parent->getLeft())
+    {
+        parent->setLeft(child);
+    }
+    else
+    {
+        parent->setRight(child);
+    }
+    if (child != nullptr)
+    {
+        child->setParent(parent);
+    }
+    threadPast(nodeToRemove);
+    uncache(nodeToRemove);
+    destroyNode(nodeToRemove);
+}
+
+
+/**
+* Turns x's right child y into the root of x's subtree, with x as its
+* left child; the keys stay in order. Only relinks: trees that keep data
+* per node fix it up themselves. If y had no left child, x is left with
+* no right child and, when threaded, gets y as its successor thread.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::rotateLeft(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getRight();
+    x->setRight(y->getLeft());
+    if (y->getLeft() != nullptr) y->getLeft()->setParent(x);
+    else if (threaded_) x->setSuccessorThread(y);
+    y->setParent(x->getParent());
+
+    if (x->getParent() == nullptr)
+    {
+        // Only the real root moves root_; detached subtrees being joined don't
+        if (root_ == x) root_ = y;
+    }
+    else if (x == x->getParent()->getLeft())
+    {
+        x->getParent()->setLeft(y);
+    }
+    else
+    {
+        x->getParent()->setRight(y);
+    }
+
+    y->setLeft(x);
+    x->setParent(y);
+}
+
+
+/**
+* The mirror image of rotateLeft. y's successor thread, if it had one,
+* pointed at x and is replaced by x itself.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::rotateRight(Node<Key, Value>* x)
+{
+    Node<Key, Value>* y = x->getLeft();
+    x->setLeft(y->getRight());
+    if (y->getRight() != nullptr) y->getRight()->setParent(x);
+    y->setParent(x->getParent());
+
+    if (x->getParent() == nullptr)
+    {
+        if (root_ == x) root_ = y;
+    }
+    else if (x == x->getParent()->getLeft())
+    {
+        x->getParent()->setLeft(y);
+    }
+    else
+    {
+        x->getParent()->setRight(y);
+    }
+
+    y->setRight(x);
+    x->setParent(y);
+}
+
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
+{
+    if (current == nullptr) return nullptr;
+
+    // Case 1: If left child exists, go to rightmost node in left subtree
+    if (current->getLeft() != nullptr) 
+    {
+        current = current->getLeft();
+        while (current->getRight() != nullptr) 
+        {
+            current = current->getRight();
+        }
+        return current;
+    }
+
+    // Case 2: Go up until we find a node which is a right child
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getLeft()) 
+    {
+        current = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+* When the tree is the only user of pool_ (and the pool knows which
+* of its slots are live), nothing needs to walk the tree: if neither Key nor Value needs destroying the pool simply
+* drops its slabs, and otherwise the destructors are run by sweeping
+* the slabs in address order. If the storage is shared with other trees
+* (after a split or join) the nodes are destroyed by walking the tree
+* instead, and the tree moves to a fresh pool of its own. Either way
+* the teardown is iterative, uses O(1) extra memory, and is safe on
+* arbitrarily deep trees.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
+{
+    if (pool_.use_count() == 1 && pool_->sweepable())
+    {
+        if (!trivialNodes())
+        {
+            pool_->forEachLive([this](void* slot)
+            {
+                destroyNode(static_cast<Node<Key, Value>*>(slot));
+            });
+        }
+        pool_->release();
+    }
+    else
+    {
+        destroySubtree(root_);
+        pool_ = std::make_shared<NodePool>(pool_->slotSize());
+    }
+    root_ = nullptr;
+    flushLookupCache();
+}
+
+/**
+* Destroys every node in a subtree without recursion or extra memory.
+* Left children are rotated up one at a time until the current node has
+* none, at which point it can be destroyed and its right subtree visited.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroySubtree(Node<Key, Value>* node)
+{
+    flushLookupCache();
+    while (node != nullptr)
+    {
+        Node<Key, Value>* left = node->getLeft();
+        if (left != nullptr)
+        {
+            node->setLeft(left->getRight());
+            left->setRight(node);
+            node = left;
+        }
+        else
+        {
+            Node<Key, Value>* right = node->getRight();
+            destroyNode(node);
+            node = right;
+        }
+    }
+}
+
+/**
+* Detaches all nodes from the tree so another tree can take them over.
+* Returns the old root and hands back the pool they live in through
+* storage; the tree itself is left empty with a fresh pool.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::takeNodes(std::shared_ptr<NodePool>& storage)
+{
+    Node<Key, Value>* root = root_;
+    storage = pool_;
+    root_ = nullptr;
+    pool_ = std::make_shared<NodePool>(storage->slotSize());
+    flushLookupCache();
+    return root;
+}
+
+/**
+* Sets the thread of every node without a right child to its in-order
+* successor, or clears them all if the tree is not threaded, in O(n).
+* The walk finds successors from the links alone, since the threads it
+* replaces may be stale (for instance after nodes moved between trees).
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::rethread()
+{
+    Node<Key, Value>* node = getSmallestNode();
+    while (node != nullptr)
+    {
+        Node<Key, Value>* next = node->getRight();
+        if (next != nullptr)
+        {
+            while (next->getLeft() != nullptr) next = next->getLeft();
+        }
+        else
+        {
+            Node<Key, Value>* child = node;
+            next = node->getParent();
+            while (next != nullptr && child == next->getRight())
+            {
+                child = next;
+                next = next->getParent();
+            }
+            node->setSuccessorThread(threaded_ ? next : nullptr);
+        }
+        node = next;
+    }
+}
+
+/**
+* Retargets the threads that ran through a node with at most one child,
+* once it has been unlinked and before it is destroyed. Only a node with
+* no right child has a thread of its own (to next); the largest key of
+* its left subtree, if it has one, was threaded to it and now goes to
+* next. A right leaf leaves its parent with an empty right slot, which
+* is threaded to next as well. A left leaf's next is its parent, whose
+* own thread does not change.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::threadPast(Node<Key, Value>* removed)
+{
+    if (!threaded_ || removed->getRight() != nullptr) return;
+
+    Node<Key, Value>* next = removed->getSuccessorThread();
+    Node<Key, Value>* parent = removed->getParent();
+    if (removed->getLeft() != nullptr)
+    {
+        Node<Key, Value>* last = removed->getLeft();
+        while (last->getRight() != nullptr) last = last->getRight();
+        last->setSuccessorThread(next);
+    }
+    else if (parent != nullptr && parent != next)
+    {
+        parent->setSuccessorThread(next);
+    }
+}
+
+/**
+* The non-const find and operator[] go through here: a key whose node is in its cache
+* slot is answered from there, and any other is searched for and, if
+* found, offered to the cache. A slot whose node has been hit since it
+* was last offered a replacement keeps that node once (the second chance
+* of CLOCK), so a run of cold keys does not flush out a hot one. Nodes
+* are cached in the slot of their own key, where uncache looks for
+* them, even if the key searched for hashes differently.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::cachedFind(const Key& key)
+{
+    if (cache_.empty()) return internalFind(key);
+
+    CacheSlot& slot = cache_[cacheSlotOf(key)];
+    Node<Key, Value>* node = slot.node;
+    if (node != nullptr && !comp_(key, node->getKey()) && !comp_(node->getKey(), key))
+    {
+        ++cacheStats_.hits;
+        if (!slot.referenced) slot.referenced = true;
+        return node;
+    }
+
+    ++cacheStats_.misses;
+    node = internalFind(key);
+    if (node == nullptr) return nullptr;
+    CacheSlot& home = cache_[cacheSlotOf(node->getKey())];
+    if (home.node != nullptr && home.referenced)
+    {
+        home.referenced = false;
+    }
+    else
+    {
+        home.node = node;
+        home.referenced = false;
+    }
+    return node;
+}
+
+/**
+* Returns the cache slot of key, mixing its hash first since std::hash
+* is the identity for integers.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::cacheSlotOf(const Key& key) const
+{
+    uint64_t mixed = static_cast<uint64_t>(LookupCacheHash<Key>::hash(key)) * UINT64_C(0x9E3779B97F4A7C15);
+    return static_cast<std::size_t>(mixed >> 32) & (cache_.size() - 1);
+}
+
+/**
+* Drops a node that is about to be destroyed from the lookup cache.
+* Every removeNode calls this once the node is unlinked.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::uncache(Node<Key, Value>* removed)
+{
+    if (cache_.empty()) return;
+    CacheSlot& slot = cache_[cacheSlotOf(removed->getKey())];
+    if (slot.node == removed)
+    {
+        slot.node = nullptr;
+        slot.referenced = false;
+    }
+}
+
+/**
+* Empties the lookup cache, for when many nodes go at once.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::flushLookupCache()
+{
+    CacheSlot empty = { nullptr, false };
+    std::fill(cache_.begin(), cache_.end(), empty);
+}
+
+
+/**
+* Constructs a node of the given type in storage taken from the pool,
+* copying or moving the key and value in as they are passed.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename K, typename V>
+NodeType* BinarySearchTree<Key, Value, Compare>::createNode(K&& key, V&& value, NodeType* parent)
+{
+    void* slot = pool_->allocate();
+    try
+    {
+        return new (slot) NodeType(std::forward<K>(key), std::forward<V>(value), parent);
+    }
+    catch (...)
+    {
+        pool_->deallocate(slot);
+        throw;
+    }
+}
+
+/**
+* Destroys a node and hands its storage back to the pool.
+* Node has no virtual destructor, so trees with derived node types
+* override this to run the right destructor. Such trees must also
+* clear() in their own destructor, since by the time this class's
+* destructor runs the override is no longer reachable.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node();
+    pool_->deallocate(node);
+}
+
+
+/**
+* Sorts items by key (only if they are not sorted already) and drops
+* all but the last of each run of equal keys, matching the overwrite
+* semantics of repeated inserts.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::sortUniqueItems(std::vector<std::pair<Key, Value> >& items) const
+{
+    struct KeyLess
+    {
+        const Compare& comp;
+        bool operator()(const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) const
+        {
+            return comp(a.first, b.first);
+        }
+    };
+    KeyLess keyLess = { comp_ };
+
+    if (!std::is_sorted(items.begin(), items.end(), keyLess))
+    {
+        std::stable_sort(items.begin(), items.end(), keyLess);
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < items.size(); ++i) 
+    {
+        if (kept > 0 && !comp_(items[kept - 1].first, items[i].first)) 
+        {
+            items[kept - 1] = std::move(items[i]);
+        } 
+        else 
+        {
+            if (kept != i) items[kept] = std::move(items[i]);
+            ++kept;
+        }
+    }
+    items.erase(items.begin() + kept, items.end());
+}
+
+/**
+* Builds a perfectly balanced subtree from the sorted, duplicate-free
+* items in [lo, hi) and returns its root, moving the items into the
+* nodes. Derived trees override this to create their own node type and
+* initialize its balance data.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::buildBalanced(std::vector<std::pair<Key, Value> >& items,
+    std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if (lo >= hi) return nullptr;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* node = createNode(std::move(items[mid].first), std::move(items[mid].second), parent);
+    node->setLeft(buildBalanced(items, lo, mid, node));
+    node->setRight(buildBalanced(items, mid + 1, hi, node));
+    return node;
+}
+
+/**
+* Called after insert or insert_or_assign overwrote the value of an
+* existing node. Derived trees that cache data computed from values
+* override this; the plain tree has nothing to do.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::valueChanged(Node<Key, Value>* /*node*/)
+{
+
+}
+
+/**
+* Returns true if destroying a node would run no code, in which case
+* clear() frees the pool without visiting the nodes. Derived trees whose
+* nodes hold more than the key and value override this.
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::trivialNodes() const
+{
+    return std::is_trivially_destructible<Key>::value &&
+        std::is_trivially_destructible<Value>::value;
+}
+
+/**
+* Returns an iterator to node, for derived trees that find nodes themselves.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iteratorAt(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* A helper function to find the smallest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
+{
     Node<Key, Value>* current = root_;
 
     if (current == nullptr) return nullptr;
@@ -648,38 +1811,85 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const
     return current;
 }
 
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getLargestNode() const
+{
+    Node<Key, Value>* current = root_;
+
+    if (current == nullptr) return nullptr;
+
+    while (current->getRight() != nullptr) 
+    {
+        current = current->getRight();
+    }
+
+    return current;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists. For keys whose comparisons may be expensive (such
+* as strings) the descent only asks whether a node is less
+* than the key, one comparison per level, and keeps the last
+* node that is not; a final comparison tells whether it is
+* equal. Comparing numbers costs less than the cache misses
+* of descending all the way to a leaf, so for them the search
+* still stops as soon as it finds the key.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const K& key) const
 {
     Node<Key, Value>* current = root_;
-    while (current != nullptr) 
+    if (std::is_arithmetic<Key>::value && std::is_arithmetic<K>::value) 
     {
-        if (key < current->getKey()) 
+        while (current != nullptr) 
         {
-            current = current->getLeft();
-        } 
-        else if (key > current->getKey()) 
+            if (comp_(key, current->getKey())) 
+            {
+                current = current->getLeft();
+            } 
+            else if (comp_(current->getKey(), key)) 
+            {
+                current = current->getRight();
+            } 
+            else 
+            {
+                return current;  // Found the node
+            }
+        }
+        return nullptr;  // Not found
+    }
+
+    Node<Key, Value>* candidate = nullptr;
+    while (current != nullptr) 
+    {
+        if (comp_(current->getKey(), key)) 
         {
             current = current->getRight();
         } 
         else 
         {
-            return current;  // Found the node
+            candidate = current;
+            current = current->getLeft();
         }
     }
+    if (candidate != nullptr && !comp_(key, candidate->getKey())) 
+    {
+        return candidate;  // Found the node
+    }
     return nullptr;  // Not found
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
     std::function<int(Node<Key, Value>*)> height = [&](Node<Key, Value>* node) 
     {
@@ -695,8 +1905,8 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
 
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
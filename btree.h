@@ -0,0 +1,893 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "key_search.h"
+#include "node_pool.h"
+
+/**
+ * A B+-tree offering the same interface as BinarySearchTree
+ * (insert, remove, find, operator[], begin/end, clear).
+ * Every node holds a sorted array of keys, so a lookup touches a few
+ * adjacent cache lines per level instead of taking a cache miss per
+ * binary-tree level, and the tree is only log_Fanout(n) levels deep.
+ * All pairs live in the leaves, which are linked left to right so
+ * iteration is a walk along arrays.
+ *
+ * Fanout is the most children an inner node has and the most pairs a
+ * leaf holds. The default makes each key array span about four 64-byte
+ * cache lines. Key must be default constructible and assignable, since
+ * the key arrays are ordinary arrays.
+ */
+template <typename Key, typename Value,
+          std::size_t Fanout = (256 / sizeof(Key) < 4 ? 4 : 256 / sizeof(Key))>
+class BTree
+{
+    static_assert(Fanout >= 4, "a BTree node needs room for at least 4 children");
+
+protected:
+    struct LeafNode;
+
+public:
+    BTree();
+    ~BTree();
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+
+public:
+    /**
+    * An iterator over the pairs in key order; a position is a leaf and
+    * a slot within it.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTree<Key, Value, Fanout>;
+        iterator(LeafNode* leaf, unsigned slot);
+        LeafNode* leaf_;
+        unsigned slot_;
+    };
+
+public:
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    // count is the number of pairs in a leaf and of children in an inner node
+    struct NodeBase
+    {
+        bool leaf;
+        unsigned count;
+    };
+
+    // The pairs are constructed in place (a pair with a const key cannot
+    // be assigned) and their keys are mirrored in keys for searching.
+    struct LeafNode : NodeBase
+    {
+        Key keys[Fanout];
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type items[Fanout];
+        LeafNode* next;
+
+        Item& item(unsigned i) { return *reinterpret_cast<Item*>(&items[i]); }
+    };
+
+    // Child i holds the keys k with keys[i-1] <= k < keys[i].
+    struct InnerNode : NodeBase
+    {
+        Key keys[Fanout - 1];
+        NodeBase* children[Fanout];
+    };
+
+    static const unsigned MIN_COUNT = Fanout / 2;   // fewest pairs/children outside the root
+
+    // Nodes set aside by reserveNodes before an insert changes the tree;
+    // the inner nodes are chained through children[0]
+    struct Reserve
+    {
+        LeafNode* leaf;
+        InnerNode* inners;
+    };
+
+    static unsigned lowerBound(const Key* keys, unsigned n, const Key& key);
+    static unsigned upperBound(const Key* keys, unsigned n, const Key& key);
+    LeafNode* findLeaf(const Key& key) const;
+
+    LeafNode* createLeaf();
+    InnerNode* createInner();
+    void destroyLeaf(LeafNode* leaf);
+    void destroyInner(InnerNode* inner);
+    void destroySubtree(NodeBase* node);
+    static void moveItem(LeafNode* from, unsigned i, LeafNode* to, unsigned j);
+
+    NodeBase* insertInto(NodeBase* node, const Item& keyValuePair, unsigned splitInners,
+        Reserve& reserve, Key& splitKey);
+    LeafNode* insertIntoLeaf(LeafNode* leaf, const Item& keyValuePair, unsigned splitInners,
+        Reserve& reserve, Key& splitKey);
+    void reserveNodes(Reserve& reserve, unsigned inners);
+    void releaseReserve(Reserve& reserve);
+    static InnerNode* takeInner(Reserve& reserve);
+    LeafNode* splitLeaf(LeafNode* leaf, Reserve& reserve);
+    InnerNode* splitInner(InnerNode* inner, Reserve& reserve, Key& upKey);
+
+    void removeFrom(NodeBase* node, const Key& key);
+    void fixUnderflow(InnerNode* parent, unsigned i);
+    void borrowFromLeft(InnerNode* parent, unsigned i);
+    void borrowFromRight(InnerNode* parent, unsigned i);
+    void mergeChildren(InnerNode* parent, unsigned i);
+
+protected:
+    NodeBase* root_;
+    NodePool leaves_;   // storage for LeafNodes
+    NodePool inners_;   // storage for InnerNodes
+};
+
+/*
+---------------------------------------------------
+Begin implementations for the BTree::iterator class.
+---------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::iterator::iterator() :
+    leaf_(nullptr),
+    slot_(0)
+{
+
+}
+
+/**
+* Explicit constructor for the pair in the given slot of a leaf.
+*/
+template<class Key, class Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::iterator::iterator(LeafNode* leaf, unsigned slot) :
+    leaf_(leaf),
+    slot_(slot)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, std::size_t Fanout>
+std::pair<const Key, Value>&
+BTree<Key, Value, Fanout>::iterator::operator*() const
+{
+    return leaf_->item(slot_);
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, std::size_t Fanout>
+std::pair<const Key, Value>*
+BTree<Key, Value, Fanout>::iterator::operator->() const
+{
+    return &leaf_->item(slot_);
+}
+
+/**
+* Checks if both iterators refer to the same position.
+*/
+template<class Key, class Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && slot_ == rhs.slot_;
+}
+
+/**
+* Checks if the iterators refer to different positions.
+*/
+template<class Key, class Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next slot, moving on to the next leaf at the end of
+* this one. Leaves are never empty, so no skipping is needed.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator&
+BTree<Key, Value, Fanout>::iterator::operator++()
+{
+    if(leaf_ == nullptr) return *this;
+    if(++slot_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        slot_ = 0;
+    }
+    return *this;
+}
+
+/*
+-------------------------------------------------
+End implementations for the BTree::iterator class.
+-------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the BTree class.
+-------------------------------------------
+*/
+
+/**
+* Default constructor; the tree starts out without any nodes.
+*/
+template<class Key, class Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::BTree() :
+    root_(nullptr),
+    leaves_(sizeof(LeafNode)),
+    inners_(sizeof(InnerNode))
+{
+
+}
+
+template<class Key, class Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::~BTree()
+{
+    clear();
+}
+
+/**
+* Returns true if the tree is empty.
+*/
+template<class Key, class Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+* Returns an iterator to the smallest item in the tree.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::begin() const
+{
+    NodeBase* node = root_;
+    if(node == nullptr) return end();
+    while(!node->leaf) {
+        node = static_cast<InnerNode*>(node)->children[0];
+    }
+    return iterator(static_cast<LeafNode*>(node), 0);
+}
+
+/**
+* Returns an iterator whose value means INVALID.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key
+* or the end iterator if the key does not exist in the tree.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::find(const Key& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if(leaf == nullptr) return end();
+    unsigned i = lowerBound(leaf->keys, leaf->count, key);
+    if(i == leaf->count || key < leaf->keys[i]) return end();
+    return iterator(leaf, i);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, std::size_t Fanout>
+Value& BTree<Key, Value, Fanout>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+template<class Key, class Value, std::size_t Fanout>
+Value const & BTree<Key, Value, Fanout>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Inserts a pair, overwriting the value if the key is already in the
+* tree. A full node is split in half and the split propagates up; a
+* split of the root grows the tree by one level.
+*
+* The copy of the pair and every node the splits need are made before
+* the tree changes, so if one of them throws the tree is left as it
+* was. Moving pairs and copying keys are assumed not to throw, as
+* everywhere else in the tree (see moveItem).
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if(root_ == nullptr) {
+        root_ = createLeaf();
+    }
+
+    Key splitKey;
+    NodeBase* sibling;
+    Reserve reserve = {nullptr, nullptr};
+    try {
+        // A split that reaches the root needs one more node for a new root
+        sibling = insertInto(root_, keyValuePair, 1, reserve, splitKey);
+    }
+    catch(...) {
+        // Don't leave behind the empty root leaf made for this pair
+        if(root_->leaf && root_->count == 0) {
+            destroyLeaf(static_cast<LeafNode*>(root_));
+            root_ = nullptr;
+        }
+        throw;
+    }
+    if(sibling == nullptr) return;
+
+    InnerNode* root = takeInner(reserve);
+    root->keys[0] = std::move(splitKey);
+    root->children[0] = root_;
+    root->children[1] = sibling;
+    root->count = 2;
+    root_ = root;
+}
+
+/**
+* Inserts into the subtree at node. If node had to split, returns the
+* new right sibling and stores the smallest key that belongs to the
+* sibling in splitKey; otherwise returns nullptr.
+*
+* splitInners is the number of inner nodes a split of node would use
+* above it: one for each full ancestor it would carry on into, plus
+* the new root if it reaches that. The leaf sets them aside in reserve,
+* along with its own new sibling, if it has to split.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::NodeBase*
+BTree<Key, Value, Fanout>::insertInto(NodeBase* node, const Item& keyValuePair, unsigned splitInners,
+    Reserve& reserve, Key& splitKey)
+{
+    if(node->leaf) {
+        return insertIntoLeaf(static_cast<LeafNode*>(node), keyValuePair, splitInners, reserve, splitKey);
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    unsigned i = upperBound(inner->keys, inner->count - 1, keyValuePair.first);
+    unsigned childInners = inner->count == Fanout ? splitInners + 1 : 0;
+    Key childKey;
+    NodeBase* childSibling = insertInto(inner->children[i], keyValuePair, childInners, reserve, childKey);
+    if(childSibling == nullptr) return nullptr;
+
+    InnerNode* sibling = nullptr;
+    InnerNode* target = inner;
+    if(inner->count == Fanout) {
+        sibling = splitInner(inner, reserve, splitKey);
+        if(i >= inner->count) {
+            target = sibling;
+            i -= inner->count;
+        }
+    }
+
+    // The new child goes right after child i, separated by childKey
+    for(unsigned j = target->count - 1; j > i; --j) {
+        target->keys[j] = std::move(target->keys[j - 1]);
+        target->children[j + 1] = target->children[j];
+    }
+    target->keys[i] = std::move(childKey);
+    target->children[i + 1] = childSibling;
+    ++target->count;
+    return sibling;
+}
+
+/**
+* Leaf case of insertInto. A full leaf is split before the pair is
+* placed, so the pair always lands in a leaf with room to spare. The
+* pair is copied, and the nodes for the splits reserved, before any
+* node changes.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::LeafNode*
+BTree<Key, Value, Fanout>::insertIntoLeaf(LeafNode* leaf, const Item& keyValuePair, unsigned splitInners,
+    Reserve& reserve, Key& splitKey)
+{
+    unsigned i = lowerBound(leaf->keys, leaf->count, keyValuePair.first);
+    if(i < leaf->count && !(keyValuePair.first < leaf->keys[i])) {
+        leaf->item(i).second = keyValuePair.second;
+        return nullptr;
+    }
+
+    typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage;
+    Item* item = new (&storage) Item(keyValuePair);
+    LeafNode* sibling = nullptr;
+    LeafNode* target = leaf;
+    if(leaf->count == Fanout) {
+        try {
+            reserveNodes(reserve, splitInners);
+        }
+        catch(...) {
+            releaseReserve(reserve);
+            item->~Item();
+            throw;
+        }
+        sibling = splitLeaf(leaf, reserve);
+        splitKey = sibling->keys[0];
+        if(i > leaf->count) {
+            target = sibling;
+            i -= leaf->count;
+        }
+    }
+
+    for(unsigned j = target->count; j > i; --j) {
+        moveItem(target, j - 1, target, j);
+    }
+    new (&target->items[i]) Item(std::move(*item));
+    item->~Item();
+    target->keys[i] = keyValuePair.first;
+    ++target->count;
+    return sibling;
+}
+
+/**
+* Sets aside a leaf and the given number of inner nodes for the splits
+* of an insert. If an allocation throws, the nodes already set aside
+* stay in reserve for the caller to release.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::reserveNodes(Reserve& reserve, unsigned inners)
+{
+    reserve.leaf = createLeaf();
+    for(unsigned i = 0; i < inners; ++i) {
+        InnerNode* inner = createInner();
+        inner->children[0] = reserve.inners;
+        reserve.inners = inner;
+    }
+}
+
+/**
+* Gives back any nodes still in a reserve.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::releaseReserve(Reserve& reserve)
+{
+    if(reserve.leaf != nullptr) {
+        destroyLeaf(reserve.leaf);
+        reserve.leaf = nullptr;
+    }
+    while(reserve.inners != nullptr) {
+        destroyInner(takeInner(reserve));
+    }
+}
+
+/**
+* Takes one of the inner nodes set aside by reserveNodes.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::InnerNode*
+BTree<Key, Value, Fanout>::takeInner(Reserve& reserve)
+{
+    InnerNode* inner = reserve.inners;
+    reserve.inners = static_cast<InnerNode*>(inner->children[0]);
+    return inner;
+}
+
+/**
+* Moves the upper half of a full leaf into the reserved leaf and links
+* that in after it.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::LeafNode*
+BTree<Key, Value, Fanout>::splitLeaf(LeafNode* leaf, Reserve& reserve)
+{
+    LeafNode* sibling = reserve.leaf;
+    reserve.leaf = nullptr;
+    unsigned keep = Fanout / 2;
+    for(unsigned j = keep; j < Fanout; ++j) {
+        moveItem(leaf, j, sibling, j - keep);
+    }
+    sibling->count = Fanout - keep;
+    leaf->count = keep;
+    sibling->next = leaf->next;
+    leaf->next = sibling;
+    return sibling;
+}
+
+/**
+* Moves the upper half of the children of a full inner node into a
+* reserved node. The key between the halves is handed back in upKey for
+* the parent, since neither half keeps it.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::InnerNode*
+BTree<Key, Value, Fanout>::splitInner(InnerNode* inner, Reserve& reserve, Key& upKey)
+{
+    InnerNode* sibling = takeInner(reserve);
+    unsigned keep = Fanout / 2;
+    for(unsigned j = keep; j < Fanout; ++j) {
+        sibling->children[j - keep] = inner->children[j];
+    }
+    for(unsigned j = keep; j < Fanout - 1; ++j) {
+        sibling->keys[j - keep] = std::move(inner->keys[j]);
+    }
+    upKey = std::move(inner->keys[keep - 1]);
+    sibling->count = Fanout - keep;
+    inner->count = keep;
+    return sibling;
+}
+
+/**
+* Removes the pair with the given key if there is one. Nodes left less
+* than half full borrow from or merge with a sibling on the way back
+* up, and a root with a single child is replaced by that child.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::remove(const Key& key)
+{
+    if(root_ == nullptr) return;
+    removeFrom(root_, key);
+
+    if(root_->leaf) {
+        if(root_->count == 0) {
+            destroyLeaf(static_cast<LeafNode*>(root_));
+            root_ = nullptr;
+        }
+    }
+    else if(root_->count == 1) {
+        InnerNode* old = static_cast<InnerNode*>(root_);
+        root_ = old->children[0];
+        destroyInner(old);
+    }
+}
+
+/**
+* Removes key from the subtree at node, fixing up any child that ends
+* up under MIN_COUNT. node itself may be left under MIN_COUNT; that is
+* for its parent to fix.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::removeFrom(NodeBase* node, const Key& key)
+{
+    if(node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        unsigned i = lowerBound(leaf->keys, leaf->count, key);
+        if(i == leaf->count || key < leaf->keys[i]) return;
+        leaf->item(i).~Item();
+        for(unsigned j = i + 1; j < leaf->count; ++j) {
+            moveItem(leaf, j, leaf, j - 1);
+        }
+        --leaf->count;
+        return;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    unsigned i = upperBound(inner->keys, inner->count - 1, key);
+    removeFrom(inner->children[i], key);
+    if(inner->children[i]->count < MIN_COUNT) {
+        fixUnderflow(inner, i);
+    }
+}
+
+/**
+* Restores child i of parent to at least MIN_COUNT, borrowing from a
+* sibling that can spare one, or else merging with a sibling.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::fixUnderflow(InnerNode* parent, unsigned i)
+{
+    if(i > 0 && parent->children[i - 1]->count > MIN_COUNT) {
+        borrowFromLeft(parent, i);
+    }
+    else if(i + 1 < parent->count && parent->children[i + 1]->count > MIN_COUNT) {
+        borrowFromRight(parent, i);
+    }
+    else if(i > 0) {
+        mergeChildren(parent, i - 1);
+    }
+    else {
+        mergeChildren(parent, i);
+    }
+}
+
+/**
+* Moves the last pair (or child) of child i - 1 to the front of child i
+* and updates the separator between them.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::borrowFromLeft(InnerNode* parent, unsigned i)
+{
+    if(parent->children[i]->leaf) {
+        LeafNode* left = static_cast<LeafNode*>(parent->children[i - 1]);
+        LeafNode* child = static_cast<LeafNode*>(parent->children[i]);
+        for(unsigned j = child->count; j > 0; --j) {
+            moveItem(child, j - 1, child, j);
+        }
+        moveItem(left, left->count - 1, child, 0);
+        --left->count;
+        ++child->count;
+        parent->keys[i - 1] = child->keys[0];
+        return;
+    }
+
+    InnerNode* left = static_cast<InnerNode*>(parent->children[i - 1]);
+    InnerNode* child = static_cast<InnerNode*>(parent->children[i]);
+    for(unsigned j = child->count; j > 0; --j) {
+        child->children[j] = child->children[j - 1];
+    }
+    for(unsigned j = child->count - 1; j > 0; --j) {
+        child->keys[j] = std::move(child->keys[j - 1]);
+    }
+    child->keys[0] = std::move(parent->keys[i - 1]);
+    child->children[0] = left->children[left->count - 1];
+    parent->keys[i - 1] = std::move(left->keys[left->count - 2]);
+    --left->count;
+    ++child->count;
+}
+
+/**
+* Moves the first pair (or child) of child i + 1 to the back of child i
+* and updates the separator between them.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::borrowFromRight(InnerNode* parent, unsigned i)
+{
+    if(parent->children[i]->leaf) {
+        LeafNode* child = static_cast<LeafNode*>(parent->children[i]);
+        LeafNode* right = static_cast<LeafNode*>(parent->children[i + 1]);
+        moveItem(right, 0, child, child->count);
+        for(unsigned j = 1; j < right->count; ++j) {
+            moveItem(right, j, right, j - 1);
+        }
+        --right->count;
+        ++child->count;
+        parent->keys[i] = right->keys[0];
+        return;
+    }
+
+    InnerNode* child = static_cast<InnerNode*>(parent->children[i]);
+    InnerNode* right = static_cast<InnerNode*>(parent->children[i + 1]);
+    child->keys[child->count - 1] = std::move(parent->keys[i]);
+    child->children[child->count] = right->children[0];
+    parent->keys[i] = std::move(right->keys[0]);
+    for(unsigned j = 0; j + 2 < right->count; ++j) {
+        right->keys[j] = std::move(right->keys[j + 1]);
+    }
+    for(unsigned j = 0; j + 1 < right->count; ++j) {
+        right->children[j] = right->children[j + 1];
+    }
+    --right->count;
+    ++child->count;
+}
+
+/**
+* Merges child i + 1 of parent into child i and drops it (and the
+* separator between them) from parent. Only called when the two fit
+* into one node.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::mergeChildren(InnerNode* parent, unsigned i)
+{
+    if(parent->children[i]->leaf) {
+        LeafNode* left = static_cast<LeafNode*>(parent->children[i]);
+        LeafNode* right = static_cast<LeafNode*>(parent->children[i + 1]);
+        for(unsigned j = 0; j < right->count; ++j) {
+            moveItem(right, j, left, left->count + j);
+        }
+        left->count += right->count;
+        left->next = right->next;
+        right->count = 0;
+        destroyLeaf(right);
+    }
+    else {
+        InnerNode* left = static_cast<InnerNode*>(parent->children[i]);
+        InnerNode* right = static_cast<InnerNode*>(parent->children[i + 1]);
+        left->keys[left->count - 1] = std::move(parent->keys[i]);
+        for(unsigned j = 0; j + 1 < right->count; ++j) {
+            left->keys[left->count + j] = std::move(right->keys[j]);
+        }
+        for(unsigned j = 0; j < right->count; ++j) {
+            left->children[left->count + j] = right->children[j];
+        }
+        left->count += right->count;
+        destroyInner(right);
+    }
+
+    for(unsigned j = i; j + 2 < parent->count; ++j) {
+        parent->keys[j] = std::move(parent->keys[j + 1]);
+    }
+    for(unsigned j = i + 1; j + 1 < parent->count; ++j) {
+        parent->children[j] = parent->children[j + 1];
+    }
+    --parent->count;
+}
+
+/**
+* Removes every pair and releases all node storage at once. The nodes
+* are only walked when Key or Value has a destructor to run.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::clear()
+{
+    if(!std::is_trivially_destructible<Key>::value ||
+       !std::is_trivially_destructible<Value>::value)
+    {
+        destroySubtree(root_);
+    }
+    leaves_.release();
+    inners_.release();
+    root_ = nullptr;
+}
+
+/**
+* Destroys every node in a subtree. The recursion is only as deep as
+* the tree, which is a handful of levels.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::destroySubtree(NodeBase* node)
+{
+    if(node == nullptr) return;
+    if(node->leaf) {
+        destroyLeaf(static_cast<LeafNode*>(node));
+        return;
+    }
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    for(unsigned i = 0; i < inner->count; ++i) {
+        destroySubtree(inner->children[i]);
+    }
+    destroyInner(inner);
+}
+
+/**
+* Returns an empty leaf built in storage from the leaf pool.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::LeafNode* BTree<Key, Value, Fanout>::createLeaf()
+{
+    void* slot = leaves_.allocate();
+    LeafNode* leaf;
+    try {
+        leaf = new (slot) LeafNode;
+    }
+    catch(...) {
+        leaves_.deallocate(slot);
+        throw;
+    }
+    leaf->leaf = true;
+    leaf->count = 0;
+    leaf->next = nullptr;
+    return leaf;
+}
+
+/**
+* Returns an empty inner node built in storage from the inner pool.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::InnerNode* BTree<Key, Value, Fanout>::createInner()
+{
+    void* slot = inners_.allocate();
+    InnerNode* inner;
+    try {
+        inner = new (slot) InnerNode;
+    }
+    catch(...) {
+        inners_.deallocate(slot);
+        throw;
+    }
+    inner->leaf = false;
+    inner->count = 0;
+    return inner;
+}
+
+/**
+* Destroys the pairs still in a leaf, then the leaf itself.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::destroyLeaf(LeafNode* leaf)
+{
+    for(unsigned i = 0; i < leaf->count; ++i) {
+        leaf->item(i).~Item();
+    }
+    leaf->~LeafNode();
+    leaves_.deallocate(leaf);
+}
+
+/**
+* Destroys an inner node (but not its children).
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::destroyInner(InnerNode* inner)
+{
+    inner->~InnerNode();
+    inners_.deallocate(inner);
+}
+
+/**
+* Moves the pair in slot i of from into the empty slot j of to, leaving
+* slot i empty. from and to may be the same leaf.
+*/
+template<class Key, class Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::moveItem(LeafNode* from, unsigned i, LeafNode* to, unsigned j)
+{
+    new (&to->items[j]) Item(std::move(from->item(i)));
+    from->item(i).~Item();
+    to->keys[j] = std::move(from->keys[i]);
+}
+
+/**
+* Returns the leaf whose key range covers key, or nullptr if the tree
+* is empty.
+*/
+template<class Key, class Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::LeafNode* BTree<Key, Value, Fanout>::findLeaf(const Key& key) const
+{
+    NodeBase* node = root_;
+    if(node == nullptr) return nullptr;
+    while(!node->leaf) {
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        node = inner->children[upperBound(inner->keys, inner->count - 1, key)];
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+/**
+* Returns the index of the first of the n sorted keys that is not less
+* than key (n if there is none). Integer keys are searched with SIMD
+* compares; see KeySearch.
+*/
+template<class Key, class Value, std::size_t Fanout>
+unsigned BTree<Key, Value, Fanout>::lowerBound(const Key* keys, unsigned n, const Key& key)
+{
+    return KeySearch<Key>::lowerBound(keys, n, key);
+}
+
+/**
+* Returns the index of the first of the n sorted keys that is greater
+* than key (n if there is none).
+*/
+template<class Key, class Value, std::size_t Fanout>
+unsigned BTree<Key, Value, Fanout>::upperBound(const Key* keys, unsigned n, const Key& key)
+{
+    return KeySearch<Key>::upperBound(keys, n, key);
+}
+
+/*
+-----------------------------------------
+End implementations for the BTree class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,177 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include "concurrent_avl.h"
+
+using namespace std;
+
+// Stress test for ConcurrentAVLTree, meant to be built with
+// -fsanitize=thread (make concurrent-stress). Writers insert and remove
+// keys of their own while readers look keys up; each writer keeps a
+// std::map of what its keys should hold, and at the end the tree has to
+// match the union of those maps and still be balanced.
+
+typedef ConcurrentAVLTree<uint64_t, uint64_t> Tree;
+
+static const size_t WRITERS = 4;
+static const size_t READERS = 4;
+static const uint64_t KEYS = 1 << 12;
+static const size_t OPS_PER_WRITER = 50000;
+
+// A value that names its key, so a reader can tell it got the right one.
+static uint64_t valueFor(uint64_t key, uint64_t seq)
+{
+    return (key << 32) | seq;
+}
+
+// Counts the checks that fail, printing the first few. Writers check
+// too, so the count is atomic.
+static atomic<size_t> failures(0);
+static void check(bool ok, const char* what)
+{
+    if(ok) return;
+    if(++failures <= 10) cout << "FAILED: " << what << endl;
+}
+
+// Checks that tree holds exactly the keys of the models, each with the
+// value its writer last stored.
+static void checkContents(const Tree& tree, const vector<map<uint64_t, uint64_t> >& models,
+    uint64_t keys)
+{
+    size_t expected = 0;
+    for(size_t w = 0; w < models.size(); ++w) expected += models[w].size();
+    check(tree.size() == expected, "size matches the models");
+
+    for(uint64_t key = 0; key < keys; ++key) {
+        const map<uint64_t, uint64_t>& model = models[key % models.size()];
+        map<uint64_t, uint64_t>::const_iterator it = model.find(key);
+        uint64_t value;
+        bool found = tree.find(key, value);
+        if(it == model.end()) check(!found, "removed key is absent");
+        else check(found && value == it->second, "key holds its last value");
+    }
+}
+
+// Writer w owns the keys equal to w modulo WRITERS and mirrors every
+// change it makes in its model.
+static void writeKeys(Tree& tree, size_t w, map<uint64_t, uint64_t>& model)
+{
+    mt19937_64 rng(100 + w);
+    for(size_t i = 0; i < OPS_PER_WRITER; ++i) {
+        uint64_t key = (rng() % (KEYS / WRITERS)) * WRITERS + w;
+        if(rng() % 3 != 0) {
+            uint64_t value = valueFor(key, i);
+            bool isNew = model.find(key) == model.end();
+            check(tree.insert(make_pair(key, value)) == isNew, "insert reports a new key");
+            model[key] = value;
+        }
+        else {
+            bool present = model.erase(key) != 0;
+            check(tree.remove(key) == present, "remove reports a present key");
+        }
+    }
+}
+
+// Looks up random keys until done, checking that any value found belongs
+// to the key looked up.
+static void readKeys(const Tree& tree, size_t r, const atomic<bool>& done, atomic<size_t>& bad)
+{
+    mt19937_64 rng(200 + r);
+    size_t wrong = 0;
+    uint64_t value;
+    while(!done.load()) {
+        uint64_t key = rng() % KEYS;
+        if(tree.find(key, value) && (value >> 32) != key) ++wrong;
+    }
+    bad.fetch_add(wrong);
+}
+
+// Runs the writers against readers, then checks the tree against the
+// writers' models.
+static void stressMixed()
+{
+    Tree tree;
+    vector<map<uint64_t, uint64_t> > models(WRITERS);
+    atomic<bool> done(false);
+    atomic<size_t> bad(0);
+
+    vector<thread> readers;
+    for(size_t r = 0; r < READERS; ++r) {
+        readers.push_back(thread([&, r]() { readKeys(tree, r, done, bad); }));
+    }
+    vector<thread> writers;
+    for(size_t w = 0; w < WRITERS; ++w) {
+        writers.push_back(thread([&, w]() { writeKeys(tree, w, models[w]); }));
+    }
+    for(size_t w = 0; w < WRITERS; ++w) writers[w].join();
+    done.store(true);
+    for(size_t r = 0; r < READERS; ++r) readers[r].join();
+
+    check(bad.load() == 0, "readers only see values of the keys they look up");
+    check(tree.isBalanced(), "tree is balanced after mixed writes");
+    checkContents(tree, models, KEYS);
+}
+
+// Fills a tree with n keys in random order, then has the writers remove
+// all but a few while readers look up the keys that stay. Removing keys
+// leaves routing nodes behind and the rotations that follow move them
+// around, so isBalanced, which also checks that every routing node still
+// has two children, catches any left stranded.
+static void stressDrain(uint64_t n, size_t keep)
+{
+    Tree tree;
+    vector<uint64_t> keys(n);
+    for(uint64_t i = 0; i < n; ++i) keys[i] = i;
+    shuffle(keys.begin(), keys.end(), mt19937_64(300));
+    for(size_t i = 0; i < keys.size(); ++i) tree.insert(make_pair(keys[i], valueFor(keys[i], 0)));
+
+    vector<map<uint64_t, uint64_t> > models(WRITERS);
+    for(size_t i = 0; i < keep; ++i) models[keys[i] % WRITERS][keys[i]] = valueFor(keys[i], 0);
+
+    atomic<bool> done(false);
+    atomic<size_t> misses(0);
+    vector<thread> readers;
+    for(size_t r = 0; r < READERS; ++r) {
+        readers.push_back(thread([&, r]() {
+            size_t missed = 0;
+            uint64_t value;
+            for(size_t i = r; !done.load(); i = (i + READERS) % keep) {
+                if(!tree.find(keys[i], value) || value != valueFor(keys[i], 0)) ++missed;
+            }
+            misses.fetch_add(missed);
+        }));
+    }
+    vector<thread> writers;
+    for(size_t w = 0; w < WRITERS; ++w) {
+        writers.push_back(thread([&, w]() {
+            for(size_t i = keep + w; i < keys.size(); i += WRITERS) {
+                check(tree.remove(keys[i]), "drained key was present");
+            }
+        }));
+    }
+    for(size_t w = 0; w < WRITERS; ++w) writers[w].join();
+    done.store(true);
+    for(size_t r = 0; r < READERS; ++r) readers[r].join();
+
+    check(misses.load() == 0, "keys that stay are always found");
+    check(tree.isBalanced(), "tree is balanced with no stranded routing nodes after draining");
+    checkContents(tree, models, n);
+}
+
+int main()
+{
+    stressMixed();
+    stressDrain(100000, 10);
+    if(failures.load() != 0) {
+        cout << failures.load() << " checks failed" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "concurrent-stress passed" << endl;
+    return EXIT_SUCCESS;
+}
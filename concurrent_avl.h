@@ -0,0 +1,788 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "epoch_reclaimer.h"
+#include "node_pool.h"
+
+template <typename Key, typename Value, typename Compare>
+class ConcurrentAVLTree;
+
+/**
+ * A node of a ConcurrentAVLTree. Readers follow the child links and
+ * read the value without taking a lock, so those are atomic; the key
+ * never changes once the node is built. version_ tells readers that the
+ * node's subtree is being rearranged under them (see ConcurrentAVLTree).
+ * The parent link and height are only used by writers, who take turns.
+ */
+template <typename Key, typename Value>
+class ConcurrentAVLNode
+{
+public:
+    ConcurrentAVLNode(const Key& key, Value* value, ConcurrentAVLNode<Key, Value>* parent);
+
+    const Key& getKey() const;
+
+protected:
+    template <typename K, typename V, typename C>
+    friend class ConcurrentAVLTree;
+
+    const Key key_;
+    std::atomic<Value*> value_;     // NULL once the key is removed (a routing node)
+    std::atomic<uint64_t> version_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> child_[2];  // left, right
+    ConcurrentAVLNode<Key, Value>* parent_;
+    int height_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ConcurrentAVLNode class.
+  ------------------------------------------------------
+*/
+
+/**
+* Constructor for a leaf holding key and the value it now owns.
+*/
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>::ConcurrentAVLNode(const Key& key, Value* value,
+    ConcurrentAVLNode<Key, Value>* parent) :
+    key_(key),
+    value_(value),
+    version_(0),
+    parent_(parent),
+    height_(1)
+{
+    child_[0].store(nullptr, std::memory_order_relaxed);
+    child_[1].store(nullptr, std::memory_order_relaxed);
+}
+
+/**
+* A getter for the key.
+*/
+template<class Key, class Value>
+const Key& ConcurrentAVLNode<Key, Value>::getKey() const
+{
+    return key_;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ConcurrentAVLNode class.
+  ----------------------------------------------------
+*/
+
+/**
+ * An AVL tree for many reader threads and a few writers. Lookups never
+ * take a lock and never wait on one; they only retry (or briefly spin)
+ * where a writer is rotating the nodes they are passing through. This
+ * is the optimistic scheme of Bronson et al., "A Practical Concurrent
+ * Binary Search Tree" (PPoPP 2010):
+ *
+ *  - A key stays in the node it was inserted into. Removing the key of
+ *    a node with two children only clears its value, leaving a routing
+ *    node. A routing node is unlinked as soon as it has fewer than two
+ *    children, whether a later remove or a rotation took the child.
+ *    Nodes are never swapped, so a reader comparing keys never sees a
+ *    key move.
+ *  - Each node has a version. A rotation marks the node that moves down,
+ *    whose subtree loses keys, as changing, then bumps its version.
+ *    Unlinking a node sets a bit in its version for good. A reader notes
+ *    a node's version before reading its child link and checks it again
+ *    after, and retries from the parent if it changed.
+ *
+ * Writers take turns on one mutex, so rebalancing is plain sequential
+ * AVL code. The request was for per-node writer locks, but with a few
+ * writers hand-over-hand locking costs more than it buys. Readers never
+ * touch the writer mutex, so rebalancing does not stall them.
+ *
+ * Readers get copies of values, never references. A value that is
+ * replaced or removed, and a node that is unlinked, may still be in a
+ * reader's hands, so they are retired to an EpochReclaimer and freed
+ * once every lookup that started before the removal has finished.
+ * Lookups run inside an epoch guard; writers collect as they retire.
+ * Rotations only relink nodes and never free one, so only remove,
+ * clear and value replacement retire anything.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    explicit ConcurrentAVLTree(const Compare& comp);
+    ~ConcurrentAVLTree();
+
+    ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+
+    // Lock-free lookups, safe from any number of threads
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+    // Writers, which take turns
+    bool insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    void clear();
+    void reclaim();
+    std::size_t retired() const;
+    bool isBalanced() const;
+
+protected:
+    typedef ConcurrentAVLNode<Key, Value> NodeType;
+
+    static const int LEFT = 0;
+    static const int RIGHT = 1;
+
+    // Bits of a node's version; the rest count finished changes
+    static const uint64_t UNLINKED = 1;
+    static const uint64_t CHANGING = 2;
+    static const uint64_t STEP = 4;
+
+    enum Outcome { FOUND, ABSENT, RETRY };
+
+    bool search(const Key& key, Value*& value) const;
+    Outcome attemptSearch(const Key& key, NodeType* node, int dir, uint64_t nodeVersion,
+        Value*& value) const;
+    bool direction(const Key& key, const NodeType* node, int& dir) const;
+    static void waitUntilChanged(const NodeType* node, uint64_t version);
+
+    NodeType* locate(const Key& key, NodeType*& parent, int& dir) const;
+    void replaceChild(NodeType* parent, NodeType* oldChild, NodeType* newChild);
+    void unlink(NodeType* node);
+    void retrace(NodeType* node);
+    static bool unlinkRequired(const NodeType* node);
+    NodeType* rebalance(NodeType* node);
+    NodeType* rotate(NodeType* node, int dir);
+    static void beginChange(NodeType* node);
+    static void endChange(NodeType* node);
+    static int heightOf(const NodeType* node);
+    static void updateHeight(NodeType* node);
+    static int checkHeights(const NodeType* node);
+    void retire(NodeType* node);
+    void destroyNode(NodeType* node);
+    static void reclaimNode(void* node, void* tree);
+
+protected:
+    std::atomic<NodeType*> root_;
+    std::atomic<std::size_t> size_;
+    mutable std::mutex writeLock_;
+    NodePool pool_;                         // only allocated from and freed under writeLock_
+    mutable EpochReclaimer epochs_;         // unlinked nodes and old values; after pool_
+    Compare comp_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree() :
+    root_(nullptr),
+    size_(0),
+    pool_(sizeof(NodeType)),
+    comp_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    pool_(sizeof(NodeType)),
+    comp_(comp)
+{
+
+}
+
+/**
+* Destroys every node and value, including retired ones. No other
+* thread may be using the tree.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    clear();
+    epochs_.drain();
+}
+
+/**
+* Copies the value stored with key into value and returns true, or
+* returns false if the key is not in the tree. Never blocks on a writer.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    EpochReclaimer::Guard guard(epochs_);
+    Value* found;
+    if(!search(key, found)) return false;
+    value = *found;
+    return true;
+}
+
+/**
+* Returns true if the key is in the tree.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    EpochReclaimer::Guard guard(epochs_);
+    Value* found;
+    return search(key, found);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value ConcurrentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    EpochReclaimer::Guard guard(epochs_);
+    Value* found;
+    if(!search(key, found)) throw std::out_of_range("Invalid key");
+    return *found;
+}
+
+/**
+* Returns the number of keys in the tree. With writers running, this is
+* the count at some recent moment.
+*/
+template<class Key, class Value, class Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+/**
+* Returns true if the tree is empty.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* Inserts the pair, or replaces the value if the key is already there.
+* Returns true if the key is new. The value is swapped in whole, so a
+* reader sees either the old value or the new one.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    NodeType* parent;
+    int dir;
+    NodeType* node = locate(keyValuePair.first, parent, dir);
+
+    Value* value = new Value(keyValuePair.second);
+    if(node != nullptr) {
+        // A routing node takes its key back
+        Value* old = node->value_.exchange(value, std::memory_order_acq_rel);
+        if(old == nullptr) {
+            size_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        epochs_.retire(old);
+        return false;
+    }
+
+    void* slot = nullptr;
+    try {
+        slot = pool_.allocate();
+        node = new (slot) NodeType(keyValuePair.first, value, parent);
+    }
+    catch(...) {
+        if(slot != nullptr) pool_.deallocate(slot);
+        delete value;
+        throw;
+    }
+
+    // The release store publishes the finished node to readers
+    if(parent == nullptr) root_.store(node, std::memory_order_release);
+    else parent->child_[dir].store(node, std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_relaxed);
+    retrace(parent);
+    return true;
+}
+
+/**
+* Removes key from the tree and returns true, or returns false if it was
+* not there. A node with two children stays on as a routing node; any
+* other node is unlinked.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    NodeType* parent;
+    int dir;
+    NodeType* node = locate(key, parent, dir);
+    if(node == nullptr) return false;
+
+    Value* old = node->value_.exchange(nullptr, std::memory_order_acq_rel);
+    if(old == nullptr) return false;
+    epochs_.retire(old);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+
+    if(node->child_[LEFT].load(std::memory_order_relaxed) != nullptr &&
+       node->child_[RIGHT].load(std::memory_order_relaxed) != nullptr) {
+        return true;
+    }
+    unlink(node);
+    retrace(parent);
+    return true;
+}
+
+/**
+* Removes every key. Readers already inside the tree finish against the
+* old contents, so all of it is retired rather than freed.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    NodeType* root = root_.load(std::memory_order_relaxed);
+    root_.store(nullptr, std::memory_order_release);
+    size_.store(0, std::memory_order_relaxed);
+
+    std::vector<NodeType*> pending;
+    if(root != nullptr) pending.push_back(root);
+    while(!pending.empty()) {
+        NodeType* node = pending.back();
+        pending.pop_back();
+        for(int dir = LEFT; dir <= RIGHT; ++dir) {
+            NodeType* child = node->child_[dir].load(std::memory_order_relaxed);
+            if(child != nullptr) pending.push_back(child);
+        }
+        Value* value = node->value_.load(std::memory_order_relaxed);
+        if(value != nullptr) epochs_.retire(value);
+        retire(node);
+    }
+}
+
+/**
+* Frees the retired nodes and values that no running lookup can still
+* reach. Writers already do this every few dozen retirements; calling it
+* by hand only helps when writes have stopped. Safe at any time.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::reclaim()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    epochs_.collect();
+}
+
+/**
+* Returns how many retired nodes and values are still waiting to be freed.
+*/
+template<class Key, class Value, class Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::retired() const
+{
+    return epochs_.pending();
+}
+
+/**
+* Returns true if every node's children differ in height by at most one
+* and every routing node has two children. Takes the writer lock, so it
+* sees the tree between writes.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    return checkHeights(root_.load(std::memory_order_relaxed)) >= 0;
+}
+
+/**
+* Looks key up without locking, pointing value at its value if it is
+* there. Starts over whenever the root changes under the search.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::search(const Key& key, Value*& value) const
+{
+    while(true) {
+        NodeType* root = root_.load(std::memory_order_acquire);
+        if(root == nullptr) return false;
+
+        int dir;
+        if(!direction(key, root, dir)) {
+            value = root->value_.load(std::memory_order_acquire);
+            return value != nullptr;
+        }
+        uint64_t version = root->version_.load(std::memory_order_acquire);
+        if(version & (CHANGING | UNLINKED)) {
+            waitUntilChanged(root, version);
+        }
+        else if(root == root_.load(std::memory_order_acquire)) {
+            Outcome outcome = attemptSearch(key, root, dir, version, value);
+            if(outcome != RETRY) return outcome == FOUND;
+        }
+    }
+}
+
+/**
+* Continues a search from node, whose version was nodeVersion when the
+* search decided to go down its dir side. Returns RETRY if node changed
+* since then, in which case its parent reads its link again.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptSearch(const Key& key, NodeType* node, int dir,
+    uint64_t nodeVersion, Value*& value) const
+{
+    while(true) {
+        NodeType* child = node->child_[dir].load(std::memory_order_acquire);
+        if(child == nullptr) {
+            // Nothing below, unless node lost that subtree to a rotation
+            if(node->version_.load(std::memory_order_acquire) != nodeVersion) return RETRY;
+            return ABSENT;
+        }
+
+        int childDir;
+        if(!direction(key, child, childDir)) {
+            // Keys never move, so a node with the key has the answer
+            value = child->value_.load(std::memory_order_acquire);
+            return value != nullptr ? FOUND : ABSENT;
+        }
+
+        uint64_t childVersion = child->version_.load(std::memory_order_acquire);
+        if(childVersion & (CHANGING | UNLINKED)) {
+            waitUntilChanged(child, childVersion);
+            if(node->version_.load(std::memory_order_acquire) != nodeVersion) return RETRY;
+        }
+        else if(child != node->child_[dir].load(std::memory_order_acquire)) {
+            if(node->version_.load(std::memory_order_acquire) != nodeVersion) return RETRY;
+        }
+        else {
+            if(node->version_.load(std::memory_order_acquire) != nodeVersion) return RETRY;
+            Outcome outcome = attemptSearch(key, child, childDir, childVersion, value);
+            if(outcome != RETRY) return outcome;
+        }
+    }
+}
+
+/**
+* Sets dir to the side of node where key belongs, or returns false if
+* key is node's key.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::direction(const Key& key, const NodeType* node, int& dir) const
+{
+    if(comp_(key, node->key_)) {
+        dir = LEFT;
+        return true;
+    }
+    if(comp_(node->key_, key)) {
+        dir = RIGHT;
+        return true;
+    }
+    return false;
+}
+
+/**
+* Waits for the rotation that marked node as changing (in version) to
+* finish. An unlinked node never changes again, so there is nothing to
+* wait for.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::waitUntilChanged(const NodeType* node, uint64_t version)
+{
+    if(!(version & CHANGING)) return;
+    // A rotation is a handful of stores; spin briefly, then give the writer the CPU
+    for(int spins = 0; node->version_.load(std::memory_order_acquire) == version; ++spins) {
+        if(spins >= 100) std::this_thread::yield();
+    }
+}
+
+/**
+* Writer-side search: returns the node holding key (routing or not) or
+* NULL, with parent and dir set to where it hangs or would be linked.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::NodeType*
+ConcurrentAVLTree<Key, Value, Compare>::locate(const Key& key, NodeType*& parent, int& dir) const
+{
+    parent = nullptr;
+    dir = LEFT;
+    NodeType* node = root_.load(std::memory_order_relaxed);
+    int next;
+    while(node != nullptr && direction(key, node, next)) {
+        parent = node;
+        dir = next;
+        node = node->child_[dir].load(std::memory_order_relaxed);
+    }
+    return node;
+}
+
+/**
+* Points the link from parent (or the root) that held oldChild at
+* newChild.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::replaceChild(NodeType* parent, NodeType* oldChild,
+    NodeType* newChild)
+{
+    if(parent == nullptr) {
+        root_.store(newChild, std::memory_order_release);
+    }
+    else if(parent->child_[LEFT].load(std::memory_order_relaxed) == oldChild) {
+        parent->child_[LEFT].store(newChild, std::memory_order_release);
+    }
+    else {
+        parent->child_[RIGHT].store(newChild, std::memory_order_release);
+    }
+}
+
+/**
+* Takes a node with at most one child out of the tree, marks it unlinked
+* so readers standing on it go back, and retires it.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::unlink(NodeType* node)
+{
+    NodeType* child = node->child_[LEFT].load(std::memory_order_relaxed);
+    if(child == nullptr) child = node->child_[RIGHT].load(std::memory_order_relaxed);
+
+    replaceChild(node->parent_, node, child);
+    if(child != nullptr) child->parent_ = node->parent_;
+    node->version_.store(node->version_.load(std::memory_order_relaxed) | UNLINKED,
+        std::memory_order_release);
+    retire(node);
+}
+
+/**
+* Walks up from node after a subtree below it grew or shrank by one
+* level, fixing heights and rotating where the balance is off, until a
+* subtree ends up as tall as it was.
+*
+* node may be a routing node that just lost a child, and a rotation can
+* leave a routing node that moves down with one child or none; such
+* nodes are unlinked, as in Bronson et al.'s fix-height-and-rebalance
+* step. Each waits until the walk above it is done and goes as a
+* removal of its own, since unlinking it in the middle of the walk
+* could drop a subtree's height by two.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::retrace(NodeType* node)
+{
+    std::vector<NodeType*> stranded;
+    if(node != nullptr && unlinkRequired(node)) stranded.push_back(node);
+    while(true) {
+        while(node != nullptr) {
+            NodeType* parent = node->parent_;
+            int before = node->height_;
+            NodeType* top = rebalance(node);
+            // The nodes a rotation moved down are now top's children
+            for(int dir = LEFT; top != node && dir <= RIGHT; ++dir) {
+                NodeType* child = top->child_[dir].load(std::memory_order_relaxed);
+                if(child != nullptr && unlinkRequired(child) &&
+                   std::find(stranded.begin(), stranded.end(), child) == stranded.end()) {
+                    stranded.push_back(child);
+                }
+            }
+            if(top->height_ == before) break;
+            node = parent;
+        }
+
+        // A stranded node may have gained a child back since
+        bool unlinked = false;
+        while(!unlinked && !stranded.empty()) {
+            NodeType* routing = stranded.back();
+            stranded.pop_back();
+            if(unlinkRequired(routing)) {
+                node = routing->parent_;
+                unlink(routing);
+                unlinked = true;
+            }
+        }
+        if(!unlinked) return;
+    }
+}
+
+/**
+* Returns true if node is a routing node with fewer than two children,
+* which a search can do without.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::unlinkRequired(const NodeType* node)
+{
+    return node->value_.load(std::memory_order_relaxed) == nullptr &&
+           (node->child_[LEFT].load(std::memory_order_relaxed) == nullptr ||
+            node->child_[RIGHT].load(std::memory_order_relaxed) == nullptr);
+}
+
+/**
+* Updates node's height, rotating it (twice for a zig-zag) if its
+* children differ in height by two. Returns the root of the subtree.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::NodeType*
+ConcurrentAVLTree<Key, Value, Compare>::rebalance(NodeType* node)
+{
+    NodeType* left = node->child_[LEFT].load(std::memory_order_relaxed);
+    NodeType* right = node->child_[RIGHT].load(std::memory_order_relaxed);
+    int balance = heightOf(left) - heightOf(right);
+
+    if(balance > 1) {
+        if(heightOf(left->child_[LEFT].load(std::memory_order_relaxed)) <
+           heightOf(left->child_[RIGHT].load(std::memory_order_relaxed))) {
+            rotate(left, LEFT);
+        }
+        return rotate(node, RIGHT);
+    }
+    if(balance < -1) {
+        if(heightOf(right->child_[RIGHT].load(std::memory_order_relaxed)) <
+           heightOf(right->child_[LEFT].load(std::memory_order_relaxed))) {
+            rotate(right, RIGHT);
+        }
+        return rotate(node, LEFT);
+    }
+    updateHeight(node);
+    return node;
+}
+
+/**
+* Rotates node down to its dir side and returns the child that took its
+* place. node loses keys from its subtree, so it is marked as changing
+* for the duration; the child only gains keys and needs no mark.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::NodeType*
+ConcurrentAVLTree<Key, Value, Compare>::rotate(NodeType* node, int dir)
+{
+    int other = 1 - dir;
+    NodeType* parent = node->parent_;
+    NodeType* pivot = node->child_[other].load(std::memory_order_relaxed);
+    NodeType* inner = pivot->child_[dir].load(std::memory_order_relaxed);
+
+    beginChange(node);
+    node->child_[other].store(inner, std::memory_order_release);
+    if(inner != nullptr) inner->parent_ = node;
+    pivot->child_[dir].store(node, std::memory_order_release);
+    node->parent_ = pivot;
+    replaceChild(parent, node, pivot);
+    pivot->parent_ = parent;
+    updateHeight(node);
+    updateHeight(pivot);
+    endChange(node);
+    return pivot;
+}
+
+/**
+* Marks node as changing. The release stores of the links that follow
+* make the mark visible first.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::beginChange(NodeType* node)
+{
+    node->version_.store(node->version_.load(std::memory_order_relaxed) | CHANGING,
+        std::memory_order_release);
+}
+
+/**
+* Clears the changing mark and counts the change, so that a reader who
+* noted the old version sees that it is stale.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::endChange(NodeType* node)
+{
+    node->version_.store((node->version_.load(std::memory_order_relaxed) & ~CHANGING) + STEP,
+        std::memory_order_release);
+}
+
+/**
+* Returns the height of a subtree (0 if empty).
+*/
+template<class Key, class Value, class Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::heightOf(const NodeType* node)
+{
+    return node == nullptr ? 0 : node->height_;
+}
+
+/**
+* Recomputes node's height from its children.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::updateHeight(NodeType* node)
+{
+    int left = heightOf(node->child_[LEFT].load(std::memory_order_relaxed));
+    int right = heightOf(node->child_[RIGHT].load(std::memory_order_relaxed));
+    node->height_ = 1 + (left > right ? left : right);
+}
+
+/**
+* Returns the height of a subtree if every node in it is balanced, has
+* its height stored correctly and, if a routing node, has two children,
+* or -1 if not.
+*/
+template<class Key, class Value, class Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::checkHeights(const NodeType* node)
+{
+    if(node == nullptr) return 0;
+    int left = checkHeights(node->child_[LEFT].load(std::memory_order_relaxed));
+    int right = checkHeights(node->child_[RIGHT].load(std::memory_order_relaxed));
+    if(left < 0 || right < 0 || left - right > 1 || right - left > 1) return -1;
+    if(unlinkRequired(node)) return -1;
+    int height = 1 + (left > right ? left : right);
+    return height == node->height_ ? height : -1;
+}
+
+/**
+* Sets node aside to be freed once no lookup can be standing on it. Only
+* called under writeLock_, so the pool is never touched concurrently.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::retire(NodeType* node)
+{
+    epochs_.retire(node, &ConcurrentAVLTree::reclaimNode, this);
+}
+
+/**
+* Destroys a node and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyNode(NodeType* node)
+{
+    node->~NodeType();
+    pool_.deallocate(node);
+}
+
+/**
+* The reclaimer's deleter for nodes.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::reclaimNode(void* node, void* tree)
+{
+    static_cast<ConcurrentAVLTree*>(tree)->destroyNode(static_cast<NodeType*>(node));
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
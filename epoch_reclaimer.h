@@ -0,0 +1,390 @@
+#ifndef EPOCH_RECLAIMER_H
+#define EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Epoch-based reclamation: deferred freeing for structures that threads
+ * read without locks. A reader wraps each traversal in a Guard. A
+ * writer that unlinks an object retire()s it instead of freeing it, and
+ * the object is freed only after every guard that could have seen it
+ * has ended.
+ *
+ * Time is divided into epochs. A guard announces the epoch it started
+ * in. The epoch may only advance once every active guard has announced
+ * the current one. An object retired in epoch e is freed when the epoch
+ * reaches e + 2: by then every guard that started in e or earlier has
+ * ended, and later guards cannot reach it because it was unlinked first.
+ *
+ * Threads register themselves the first time they enter a guard on a
+ * given reclaimer. The slot they claim goes back to the reclaimer when
+ * the thread exits. Guards nest. Retiring and collecting take a mutex.
+ * Guards do not: entering one costs a thread-local lookup and an atomic
+ * exchange.
+ *
+ * The ordering between a guard's announcement and a writer's scan rests
+ * on seq_cst read-modify-writes of the announcement and of the epoch
+ * rather than on standalone fences, which ThreadSanitizer does not model.
+ */
+class EpochReclaimer
+{
+public:
+    typedef void (*Deleter)(void* object, void* context);
+
+    explicit EpochReclaimer(std::size_t batch = 64);
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+private:
+    struct Slot;
+
+public:
+    /**
+    * Marks the calling thread as reading for as long as it lives.
+    */
+    class Guard
+    {
+    public:
+        explicit Guard(const EpochReclaimer& reclaimer);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        Slot* slot_;
+    };
+
+    void retire(void* object, Deleter deleter, void* context);
+    template<typename T>
+    void retire(T* object);
+    std::size_t collect();
+    void drain();
+    std::size_t pending() const;
+    uint64_t epoch() const;
+
+private:
+    static const uint64_t QUIESCENT = ~uint64_t(0);
+
+    // An object waiting for the epoch to move past the one it was retired in.
+    struct Retired
+    {
+        void* object;
+        Deleter deleter;
+        void* context;
+        uint64_t epoch;
+    };
+
+    // One registered thread. Shared with that thread's cache, so whichever
+    // of the two goes away last frees it.
+    struct Slot
+    {
+        Slot();
+
+        std::atomic<uint64_t> announced;    // epoch of the active guard, or QUIESCENT
+        std::atomic<bool> claimed;          // a live thread is using the slot
+        std::atomic<bool> orphaned;         // the reclaimer is gone
+        unsigned depth;                     // nested guards; owner thread only
+        char padding[64];                   // keep announcements on separate cache lines
+    };
+
+    // The slots a thread holds, one per reclaimer it has used.
+    struct ThreadCache
+    {
+        ~ThreadCache();
+        std::vector<std::pair<uint64_t, std::shared_ptr<Slot> > > slots;
+    };
+
+    Slot* slotForThisThread() const;
+    bool tryAdvance();
+    template<typename T>
+    static void deleteObject(void* object, void* context);
+
+    std::atomic<uint64_t> epoch_;
+    const uint64_t id_;                                 // tells reclaimers apart in thread caches
+    mutable std::mutex slotsLock_;
+    mutable std::vector<std::shared_ptr<Slot> > slots_;
+    mutable std::mutex retiredLock_;
+    std::deque<Retired> retired_;                       // in the order retired, so by epoch
+    std::size_t batch_;
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the EpochReclaimer::Guard class.
+  -----------------------------------------------------------
+*/
+
+/**
+* Enters a guard. The outermost guard of a thread announces the current
+* epoch with a seq_cst exchange, which keeps the traversal's loads from
+* running ahead of the announcement, so a writer scanning announcements
+* either sees it or has already unlinked what the traversal would have
+* found.
+*/
+inline EpochReclaimer::Guard::Guard(const EpochReclaimer& reclaimer) :
+    slot_(reclaimer.slotForThisThread())
+{
+    if(slot_->depth++ == 0) {
+        slot_->announced.exchange(reclaimer.epoch_.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    }
+}
+
+/**
+* Leaves a guard; the outermost one marks the thread quiescent again.
+*/
+inline EpochReclaimer::Guard::~Guard()
+{
+    if(--slot_->depth == 0) {
+        slot_->announced.store(QUIESCENT, std::memory_order_release);
+    }
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the EpochReclaimer::Guard class.
+  ---------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the EpochReclaimer class.
+  ---------------------------------------------------
+*/
+
+/**
+* Constructor. An automatic collect() runs every batch retirements.
+*/
+inline EpochReclaimer::EpochReclaimer(std::size_t batch) :
+    epoch_(0),
+    id_([]() {
+        static std::atomic<uint64_t> next(1);
+        return next.fetch_add(1);
+    }()),
+    batch_(batch == 0 ? 1 : batch)
+{
+
+}
+
+/**
+* Frees everything still retired and lets go of the thread slots. No
+* guard on this reclaimer may still be active.
+*/
+inline EpochReclaimer::~EpochReclaimer()
+{
+    drain();
+    std::lock_guard<std::mutex> guard(slotsLock_);
+    for(std::size_t i = 0; i < slots_.size(); ++i) {
+        slots_[i]->orphaned.store(true, std::memory_order_release);
+    }
+}
+
+/**
+* Hands object over to be freed by deleter(object, context) once no
+* guard can still be reading it. object must already be unreachable for
+* guards that start from now on. The epoch the object is tagged with is
+* read with a seq_cst read-modify-write, which orders the caller's
+* unlinking stores before it.
+*/
+inline void EpochReclaimer::retire(void* object, Deleter deleter, void* context)
+{
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(retiredLock_);
+        Retired retired = { object, deleter, context, epoch_.fetch_add(0, std::memory_order_seq_cst) };
+        retired_.push_back(retired);
+        full = retired_.size() % batch_ == 0;
+    }
+    if(full) collect();
+}
+
+/**
+* Retires an object to be freed with delete.
+*/
+template<typename T>
+void EpochReclaimer::retire(T* object)
+{
+    retire(object, &EpochReclaimer::deleteObject<T>, nullptr);
+}
+
+/**
+* Moves the epoch on if every active guard has caught up with it, then
+* frees the retired objects that no guard can see any more. Returns how
+* many were freed.
+*/
+inline std::size_t EpochReclaimer::collect()
+{
+    tryAdvance();
+    uint64_t now = epoch_.load(std::memory_order_seq_cst);
+
+    std::lock_guard<std::mutex> guard(retiredLock_);
+    std::size_t freed = 0;
+    while(!retired_.empty() && retired_.front().epoch + 2 <= now) {
+        Retired retired = retired_.front();
+        retired_.pop_front();
+        retired.deleter(retired.object, retired.context);
+        ++freed;
+    }
+    return freed;
+}
+
+/**
+* Frees every retired object without waiting. Only for when no thread
+* can be inside a guard, such as while the structure is destroyed.
+*/
+inline void EpochReclaimer::drain()
+{
+    std::lock_guard<std::mutex> guard(retiredLock_);
+    while(!retired_.empty()) {
+        Retired retired = retired_.front();
+        retired_.pop_front();
+        retired.deleter(retired.object, retired.context);
+    }
+}
+
+/**
+* Returns the number of retired objects not yet freed.
+*/
+inline std::size_t EpochReclaimer::pending() const
+{
+    std::lock_guard<std::mutex> guard(retiredLock_);
+    return retired_.size();
+}
+
+/**
+* Returns the current epoch.
+*/
+inline uint64_t EpochReclaimer::epoch() const
+{
+    return epoch_.load(std::memory_order_relaxed);
+}
+
+/**
+* Returns the calling thread's slot, claiming or creating one the first
+* time the thread uses this reclaimer. Cache entries of reclaimers that
+* no longer exist are dropped along the way.
+*/
+inline EpochReclaimer::Slot* EpochReclaimer::slotForThisThread() const
+{
+    static thread_local ThreadCache cache;
+    std::vector<std::pair<uint64_t, std::shared_ptr<Slot> > >& slots = cache.slots;
+    for(std::size_t i = 0; i < slots.size(); ++i) {
+        if(slots[i].first == id_) return slots[i].second.get();
+    }
+    for(std::size_t i = 0; i < slots.size(); ) {
+        if(slots[i].second->orphaned.load(std::memory_order_acquire)) {
+            slots[i] = slots.back();
+            slots.pop_back();
+        }
+        else {
+            ++i;
+        }
+    }
+
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> guard(slotsLock_);
+        for(std::size_t i = 0; i < slots_.size() && !slot; ++i) {
+            bool expected = false;
+            if(slots_[i]->claimed.compare_exchange_strong(expected, true)) slot = slots_[i];
+        }
+        if(!slot) {
+            slot = std::make_shared<Slot>();
+            slot->claimed.store(true, std::memory_order_relaxed);
+            slots_.push_back(slot);
+        }
+    }
+    slots.push_back(std::make_pair(id_, slot));
+    return slot.get();
+}
+
+/**
+* Advances the epoch by one if no active guard announced an older one.
+* The epoch is read with a seq_cst read-modify-write, which orders the
+* caller's unlinking stores before the scan.
+*/
+inline bool EpochReclaimer::tryAdvance()
+{
+    uint64_t current = epoch_.fetch_add(0, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> guard(slotsLock_);
+        for(std::size_t i = 0; i < slots_.size(); ++i) {
+            uint64_t announced = slots_[i]->announced.load(std::memory_order_seq_cst);
+            if(announced != QUIESCENT && announced != current) return false;
+        }
+    }
+    return epoch_.compare_exchange_strong(current, current + 1);
+}
+
+/**
+* The default deleter.
+*/
+template<typename T>
+void EpochReclaimer::deleteObject(void* object, void*)
+{
+    delete static_cast<T*>(object);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the EpochReclaimer class.
+  -------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the EpochReclaimer::Slot class.
+  ----------------------------------------------------------
+*/
+
+/**
+* Constructor for an unclaimed, quiescent slot.
+*/
+inline EpochReclaimer::Slot::Slot() :
+    announced(QUIESCENT),
+    claimed(false),
+    orphaned(false),
+    depth(0)
+{
+
+}
+
+/*
+  --------------------------------------------------------
+  End implementations for the EpochReclaimer::Slot class.
+  --------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------------------
+  Begin implementations for the EpochReclaimer::ThreadCache class.
+  -----------------------------------------------------------------
+*/
+
+/**
+* Gives the exiting thread's slots back to their reclaimers.
+*/
+inline EpochReclaimer::ThreadCache::~ThreadCache()
+{
+    for(std::size_t i = 0; i < slots.size(); ++i) {
+        slots[i].second->announced.store(QUIESCENT, std::memory_order_release);
+        slots[i].second->claimed.store(false, std::memory_order_release);
+    }
+}
+
+/*
+  ---------------------------------------------------------------
+  End implementations for the EpochReclaimer::ThreadCache class.
+  ---------------------------------------------------------------
+*/
+
+#endif
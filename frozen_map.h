@@ -0,0 +1,187 @@
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable map for read-only lookup workloads, built from a tree
+ * with freeze(). The keys are stored in one contiguous array in
+ * Eytzinger (breadth-first) order: the root at index 1 and the
+ * children of index i at 2i and 2i+1. A search then walks down the
+ * array with no data-dependent branches, and the next few levels it
+ * may touch are adjacent, so they can be prefetched ahead of time.
+ * Values live in a parallel array and are only read once the key has
+ * been found.
+ *
+ * Keys are ordered by Compare, which must match the order of the
+ * pairs it is built from. Key and Value must be default constructible.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenMap
+{
+public:
+    FrozenMap();
+    template<typename InputIterator>
+    FrozenMap(InputIterator first, InputIterator last, const Compare& comp = Compare());
+
+    const Value* find(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+    bool contains(const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+protected:
+    template<typename InputIterator>
+    void fill(InputIterator& it, std::size_t k);
+    std::size_t search(const Key& key) const;
+
+protected:
+    std::vector<Key> keys_;      // keys_[1..size_] in Eytzinger order; keys_[0] unused
+    std::vector<Value> values_;  // values_[k] belongs to keys_[k]
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+----------------------------------------------
+Begin implementations for the FrozenMap class.
+----------------------------------------------
+*/
+
+/**
+* Default constructor for an empty map.
+*/
+template<class Key, class Value, class Compare>
+FrozenMap<Key, Value, Compare>::FrozenMap() :
+    keys_(1),
+    values_(1),
+    size_(0),
+    comp_()
+{
+
+}
+
+/**
+* Builds the map from the pairs in [first, last), which must be sorted
+* by comp without duplicate keys (as a tree's iterators produce them), in
+* O(n). The range is walked twice: once to size the arrays and once
+* to fill them.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+FrozenMap<Key, Value, Compare>::FrozenMap(InputIterator first, InputIterator last, const Compare& comp) :
+    size_(0),
+    comp_(comp)
+{
+    for(InputIterator it = first; it != last; ++it) {
+        ++size_;
+    }
+    keys_.resize(size_ + 1);
+    values_.resize(size_ + 1);
+    fill(first, 1);
+}
+
+/**
+* Copies the next pairs from it into the subtree rooted at index k,
+* in order: the left subtree first, then k, then the right subtree.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+void FrozenMap<Key, Value, Compare>::fill(InputIterator& it, std::size_t k)
+{
+    if(k > size_) return;
+    fill(it, 2 * k);
+    keys_[k] = it->first;
+    values_[k] = it->second;
+    ++it;
+    fill(it, 2 * k + 1);
+}
+
+/**
+* Returns the index of the first key not less than key, or 0 if there
+* is none. Each step goes to 2k or 2k+1 using the comparison result as
+* a number rather than a branch. Leaving the array at the bottom, the
+* steps taken after the last "go left" show up as the trailing 1 bits
+* of k; shifting them off (plus that last left step) gives the answer.
+* The 16 descendants four levels down are adjacent in the array, and
+* the start of that block is prefetched at each step, which hides much
+* of the memory latency on large maps.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenMap<Key, Value, Compare>::search(const Key& key) const
+{
+    const Key* keys = keys_.data();
+    std::size_t k = 1;
+    while(k <= size_) {
+#if defined(__GNUC__)
+        __builtin_prefetch(keys + (16 * k <= size_ ? 16 * k : 0));
+#endif
+        k = 2 * k + comp_(keys[k], key);
+    }
+    // Drop the trailing 1 bits and the 0 bit above them
+    while(k & 1) k >>= 1;
+    return k >> 1;
+}
+
+/**
+* Returns a pointer to the value stored with key, or nullptr if the
+* key is not in the map.
+*/
+template<class Key, class Value, class Compare>
+const Value* FrozenMap<Key, Value, Compare>::find(const Key& key) const
+{
+    std::size_t k = search(key);
+    if(k == 0 || comp_(key, keys_[k])) return nullptr;
+    return &values_[k];
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+const Value& FrozenMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const Value* value = find(key);
+    if(value == nullptr) throw std::out_of_range("Invalid key");
+    return *value;
+}
+
+/**
+* Returns true if the key is in the map.
+*/
+template<class Key, class Value, class Compare>
+bool FrozenMap<Key, Value, Compare>::contains(const Key& key) const
+{
+    return find(key) != nullptr;
+}
+
+/**
+* Returns the number of pairs in the map.
+*/
+template<class Key, class Value, class Compare>
+std::size_t FrozenMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns true if the map is empty.
+*/
+template<class Key, class Value, class Compare>
+bool FrozenMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+/*
+--------------------------------------------
+End implementations for the FrozenMap class.
+--------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define KEY_SEARCH_X86 1
+#endif
+
+/**
+ * Binary search within one node's sorted key array, using only
+ * operator<. This is what KeySearch does for any key type without a
+ * faster specialization.
+ */
+template <typename Key>
+struct BinaryKeySearch
+{
+    static unsigned lowerBound(const Key* keys, unsigned n, const Key& key);
+    static unsigned upperBound(const Key* keys, unsigned n, const Key& key);
+};
+
+/**
+ * Search within one node's sorted key array, as used by BTree.
+ * uint32_t and uint64_t keys are specialized below to compare a whole
+ * vector of keys at once with SSE4.2 or AVX2, whichever the CPU running
+ * the program supports; every other key type (and every other CPU) gets
+ * the binary search.
+ */
+template <typename Key>
+struct KeySearch : BinaryKeySearch<Key>
+{
+
+};
+
+template <>
+struct KeySearch<uint32_t>
+{
+    static unsigned lowerBound(const uint32_t* keys, unsigned n, uint32_t key);
+    static unsigned upperBound(const uint32_t* keys, unsigned n, uint32_t key);
+};
+
+template <>
+struct KeySearch<uint64_t>
+{
+    static unsigned lowerBound(const uint64_t* keys, unsigned n, uint64_t key);
+    static unsigned upperBound(const uint64_t* keys, unsigned n, uint64_t key);
+};
+
+/**
+ * The vectorized scans behind the integer KeySearch specializations.
+ * Each returns the length of the prefix of keys[0, n) that is less than
+ * (or, with orEqual, not greater than) key, which for a sorted array is
+ * the lower (upper) bound. Rather than stopping where the prefix ends,
+ * a scan counts the matching keys of every vector, which has no
+ * data-dependent branches to mispredict. Unsigned order is compared with the
+ * signed compare instructions by flipping the top bit of both sides.
+ */
+class SimdKeySearch
+{
+public:
+    enum Level { SCALAR, SSE42, AVX2 };
+    static Level level();
+
+    static unsigned prefix(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual);
+    static unsigned prefix(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual);
+
+#ifdef KEY_SEARCH_X86
+    __attribute__((target("sse4.2")))
+    static unsigned prefixSse42(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual);
+    __attribute__((target("sse4.2")))
+    static unsigned prefixSse42(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual);
+    __attribute__((target("avx2")))
+    static unsigned prefixAvx2(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual);
+    __attribute__((target("avx2")))
+    static unsigned prefixAvx2(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual);
+#endif
+
+private:
+    template<typename Int>
+    static unsigned prefixTail(const Int* keys, unsigned i, unsigned n, Int key, bool orEqual,
+        unsigned count);
+};
+
+/*
+---------------------------------------------------
+Begin implementations for the BinaryKeySearch class.
+---------------------------------------------------
+*/
+
+/**
+* Returns the index of the first of the n sorted keys that is not less
+* than key (n if there is none).
+*/
+template<typename Key>
+unsigned BinaryKeySearch<Key>::lowerBound(const Key* keys, unsigned n, const Key& key)
+{
+    unsigned lo = 0;
+    while(n > 0) {
+        unsigned half = n / 2;
+        if(keys[lo + half] < key) {
+            lo += half + 1;
+            n -= half + 1;
+        }
+        else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+/**
+* Returns the index of the first of the n sorted keys that is greater
+* than key (n if there is none).
+*/
+template<typename Key>
+unsigned BinaryKeySearch<Key>::upperBound(const Key* keys, unsigned n, const Key& key)
+{
+    unsigned lo = 0;
+    while(n > 0) {
+        unsigned half = n / 2;
+        if(key < keys[lo + half]) {
+            n = half;
+        }
+        else {
+            lo += half + 1;
+            n -= half + 1;
+        }
+    }
+    return lo;
+}
+
+/*
+-------------------------------------------------
+End implementations for the BinaryKeySearch class.
+-------------------------------------------------
+*/
+
+/*
+---------------------------------------------
+Begin implementations for the KeySearch class.
+---------------------------------------------
+*/
+
+inline unsigned KeySearch<uint32_t>::lowerBound(const uint32_t* keys, unsigned n, uint32_t key)
+{
+    return SimdKeySearch::prefix(keys, n, key, false);
+}
+
+inline unsigned KeySearch<uint32_t>::upperBound(const uint32_t* keys, unsigned n, uint32_t key)
+{
+    return SimdKeySearch::prefix(keys, n, key, true);
+}
+
+inline unsigned KeySearch<uint64_t>::lowerBound(const uint64_t* keys, unsigned n, uint64_t key)
+{
+    return SimdKeySearch::prefix(keys, n, key, false);
+}
+
+inline unsigned KeySearch<uint64_t>::upperBound(const uint64_t* keys, unsigned n, uint64_t key)
+{
+    return SimdKeySearch::prefix(keys, n, key, true);
+}
+
+/*
+-------------------------------------------
+End implementations for the KeySearch class.
+-------------------------------------------
+*/
+
+/*
+-------------------------------------------------
+Begin implementations for the SimdKeySearch class.
+-------------------------------------------------
+*/
+
+/**
+* Returns the widest instruction set the scans may use, checked once
+* at run time.
+*/
+inline SimdKeySearch::Level SimdKeySearch::level()
+{
+#ifdef KEY_SEARCH_X86
+    static const Level detected =
+        (__builtin_cpu_init(), __builtin_cpu_supports("avx2")) ? AVX2 :
+        __builtin_cpu_supports("sse4.2") ? SSE42 : SCALAR;
+    return detected;
+#else
+    return SCALAR;
+#endif
+}
+
+/**
+* Dispatches to the widest scan the CPU supports.
+*/
+inline unsigned SimdKeySearch::prefix(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual)
+{
+#ifdef KEY_SEARCH_X86
+    Level best = level();
+    if(best == AVX2) return prefixAvx2(keys, n, key, orEqual);
+    if(best == SSE42) return prefixSse42(keys, n, key, orEqual);
+#endif
+    return orEqual ? BinaryKeySearch<uint32_t>::upperBound(keys, n, key)
+                   : BinaryKeySearch<uint32_t>::lowerBound(keys, n, key);
+}
+
+/**
+* Dispatches to the widest scan the CPU supports.
+*/
+inline unsigned SimdKeySearch::prefix(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual)
+{
+#ifdef KEY_SEARCH_X86
+    Level best = level();
+    if(best == AVX2) return prefixAvx2(keys, n, key, orEqual);
+    if(best == SSE42) return prefixSse42(keys, n, key, orEqual);
+#endif
+    return orEqual ? BinaryKeySearch<uint64_t>::upperBound(keys, n, key)
+                   : BinaryKeySearch<uint64_t>::lowerBound(keys, n, key);
+}
+
+/**
+* Adds the keys from index i on that are inside the prefix to count,
+* one at a time, for the keys left over after the last full vector.
+*/
+template<typename Int>
+unsigned SimdKeySearch::prefixTail(const Int* keys, unsigned i, unsigned n, Int key, bool orEqual,
+    unsigned count)
+{
+    for(; i < n; ++i) {
+        count += keys[i] < key || (orEqual && keys[i] == key);
+    }
+    return count;
+}
+
+#ifdef KEY_SEARCH_X86
+
+/**
+* Four uint32_t keys per compare.
+*/
+__attribute__((target("sse4.2")))
+inline unsigned SimdKeySearch::prefixSse42(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual)
+{
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i probe = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(key)), bias);
+    const int full = 0xF;
+    unsigned i = 0;
+    unsigned count = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+        int inside = orEqual
+            ? full ^ _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, probe)))
+            : _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(probe, block)));
+        count += __builtin_popcount(inside);
+    }
+    return prefixTail(keys, i, n, key, orEqual, count);
+}
+
+/**
+* Two uint64_t keys per compare (the 64-bit compare is SSE4.2).
+*/
+__attribute__((target("sse4.2")))
+inline unsigned SimdKeySearch::prefixSse42(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual)
+{
+    const __m128i bias = _mm_set1_epi64x(INT64_MIN);
+    const __m128i probe = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(key)), bias);
+    const int full = 0x3;
+    unsigned i = 0;
+    unsigned count = 0;
+    for(; i + 2 <= n; i += 2) {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+        int inside = orEqual
+            ? full ^ _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(block, probe)))
+            : _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(probe, block)));
+        count += __builtin_popcount(inside);
+    }
+    return prefixTail(keys, i, n, key, orEqual, count);
+}
+
+/**
+* Eight uint32_t keys per compare.
+*/
+__attribute__((target("avx2")))
+inline unsigned SimdKeySearch::prefixAvx2(const uint32_t* keys, unsigned n, uint32_t key, bool orEqual)
+{
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    const __m256i probe = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(key)), bias);
+    const int full = 0xFF;
+    unsigned i = 0;
+    unsigned count = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+        int inside = orEqual
+            ? full ^ _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block, probe)))
+            : _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(probe, block)));
+        count += __builtin_popcount(inside);
+    }
+    return prefixTail(keys, i, n, key, orEqual, count);
+}
+
+/**
+* Four uint64_t keys per compare.
+*/
+__attribute__((target("avx2")))
+inline unsigned SimdKeySearch::prefixAvx2(const uint64_t* keys, unsigned n, uint64_t key, bool orEqual)
+{
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i probe = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(key)), bias);
+    const int full = 0xF;
+    unsigned i = 0;
+    unsigned count = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+        int inside = orEqual
+            ? full ^ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(block, probe)))
+            : _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(probe, block)));
+        count += __builtin_popcount(inside);
+    }
+    return prefixTail(keys, i, n, key, orEqual, count);
+}
+
+#endif
+
+/*
+-----------------------------------------------
+End implementations for the SimdKeySearch class.
+-----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * A fixed-size slab allocator for tree nodes.
+ * Slots are carved out of large slabs and recycled through an intrusive
+ * free list, so allocating a node is a pointer bump or a list pop instead
+ * of a call to malloc. Every slab is owned by the pool, which lets a tree
+ * drop all of its storage at once with release() in O(#slabs).
+ *
+ * Trees that hand nodes to each other (split/join) share a pool through a
+ * shared_ptr, or one pool adopts the other so the nodes it now holds stay
+ * valid; see adopt().
+ */
+class NodePool
+{
+public:
+    explicit NodePool(std::size_t slotSize);
+    ~NodePool();
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    void* allocate();
+    void deallocate(void* slot);
+    void release();
+    template<typename Visitor>
+    void forEachLive(Visitor visit);
+    void adopt(std::shared_ptr<NodePool> other);
+
+    std::size_t slotSize() const;
+    std::size_t slabCount() const;
+    bool sweepable() const;
+
+private:
+    // A recycled slot stores the link to the next free slot in its own bytes.
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    // Header at the front of every slab; the slots follow it.
+    struct Slab
+    {
+        Slab* next;
+        std::size_t slots;
+    };
+
+    static std::size_t roundUp(std::size_t n);
+    template<typename Link>
+    static Link* sortByAddress(Link* head, Link*& tail);
+    void addSlab();
+    void reset();
+
+    static const std::size_t MIN_SLAB_SLOTS = 16;
+    static const std::size_t MAX_SLAB_SLOTS = 4096;
+
+    std::size_t slotSize_;
+    std::size_t nextSlabSlots_;
+    std::size_t slabCount_;
+    Slab* slabs_;
+    Slab* slabTail_;
+    Slab* bumpSlab_;        // the slab bump_ points into
+    FreeSlot* freeList_;
+    FreeSlot* freeTail_;
+    char* bump_;
+    char* bumpEnd_;
+    std::vector<std::shared_ptr<NodePool> > adopted_;   // pools kept alive for nodes we hold
+    bool lent_;     // another pool holds (and may free) some of our slots
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+/**
+* Creates an empty pool handing out slots of at least slotSize bytes.
+* No memory is requested until the first allocation.
+*/
+inline NodePool::NodePool(std::size_t slotSize) :
+    slotSize_(roundUp(slotSize < sizeof(FreeSlot) ? sizeof(FreeSlot) : slotSize)),
+    nextSlabSlots_(MIN_SLAB_SLOTS),
+    slabCount_(0),
+    slabs_(nullptr),
+    slabTail_(nullptr),
+    bumpSlab_(nullptr),
+    freeList_(nullptr),
+    freeTail_(nullptr),
+    bump_(nullptr),
+    bumpEnd_(nullptr),
+    lent_(false)
+{
+
+}
+
+/**
+* Returns every slab to the system. Objects still living in the pool
+* are not destroyed; the owning tree is responsible for that.
+*/
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Rounds n up to the strictest fundamental alignment so every slot
+* (and the first slot after a slab header) is suitably aligned.
+*/
+inline std::size_t NodePool::roundUp(std::size_t n)
+{
+    const std::size_t align = alignof(std::max_align_t);
+    return (n + align - 1) / align * align;
+}
+
+/**
+* Returns uninitialized storage for one node. Recycled slots are reused
+* first, then the current slab is bumped, and only when both are
+* exhausted is a new (geometrically larger) slab requested.
+*/
+inline void* NodePool::allocate()
+{
+    if(freeList_ != nullptr) {
+        FreeSlot* slot = freeList_;
+        freeList_ = slot->next;
+        if(freeList_ == nullptr) freeTail_ = nullptr;
+        return slot;
+    }
+    if(bump_ == bumpEnd_) {
+        addSlab();
+    }
+    void* slot = bump_;
+    bump_ += slotSize_;
+    return slot;
+}
+
+/**
+* Pushes a slot whose object has already been destroyed onto the free list.
+*/
+inline void NodePool::deallocate(void* slot)
+{
+    if(slot == nullptr) return;
+    FreeSlot* freed = static_cast<FreeSlot*>(slot);
+    freed->next = freeList_;
+    if(freeList_ == nullptr) freeTail_ = freed;
+    freeList_ = freed;
+}
+
+/**
+* Frees every slab at once, drops any adopted pools, and resets the
+* pool to its empty state.
+*/
+inline void NodePool::release()
+{
+    while(slabs_ != nullptr) {
+        Slab* next = slabs_->next;
+        ::operator delete(slabs_);
+        slabs_ = next;
+    }
+    adopted_.clear();
+    reset();
+}
+
+/**
+* Forgets all storage without freeing it (used once it has been
+* released or handed to another pool).
+*/
+inline void NodePool::reset()
+{
+    slabCount_ = 0;
+    nextSlabSlots_ = MIN_SLAB_SLOTS;
+    slabs_ = nullptr;
+    slabTail_ = nullptr;
+    bumpSlab_ = nullptr;
+    freeList_ = nullptr;
+    freeTail_ = nullptr;
+    bump_ = nullptr;
+    bumpEnd_ = nullptr;
+    lent_ = false;
+}
+
+/**
+* Takes responsibility for the storage of another pool of the same slot
+* size, after nodes allocated there have been moved into a tree that
+* uses this pool. If nothing else refers to the other pool its slabs,
+* free slots and adoptions are spliced into this one in O(1). Otherwise
+* (another tree still allocates from it) it is kept alive instead, and
+* slots of it freed through this pool simply join this free list. From
+* then on neither pool knows exactly which of its slots are live, so
+* neither is sweepable().
+*/
+inline void NodePool::adopt(std::shared_ptr<NodePool> other)
+{
+    if(other == nullptr || other.get() == this) return;
+    if(other.use_count() > 1) {
+        other->lent_ = true;
+        adopted_.push_back(other);
+        return;
+    }
+
+    // Only the bumped front of the other pool's current slab is in use
+    if(other->bumpSlab_ != nullptr) {
+        char* first = reinterpret_cast<char*>(other->bumpSlab_) + roundUp(sizeof(Slab));
+        other->bumpSlab_->slots = (other->bump_ - first) / slotSize_;
+    }
+    if(other->slabs_ != nullptr) {
+        if(slabs_ == nullptr) slabs_ = other->slabs_;
+        else slabTail_->next = other->slabs_;
+        slabTail_ = other->slabTail_;
+        slabCount_ += other->slabCount_;
+    }
+    if(other->freeList_ != nullptr) {
+        if(freeList_ == nullptr) freeList_ = other->freeList_;
+        else freeTail_->next = other->freeList_;
+        freeTail_ = other->freeTail_;
+    }
+    lent_ = lent_ || other->lent_;
+    for(std::size_t i = 0; i < other->adopted_.size(); ++i) {
+        if(other->adopted_[i].get() != this) adopted_.push_back(other->adopted_[i]);
+    }
+    other->adopted_.clear();
+    other->reset();
+}
+
+/**
+* Calls visit(slot) on every slot that is currently allocated, in
+* address order, using O(1) extra memory. The free list and the slab
+* list are merge-sorted by address first so that one forward sweep
+* over each slab can skip the recycled slots. This lets a tree run
+* its node destructors while streaming through memory instead of
+* chasing child pointers. visit may deallocate the slot it is given.
+* Only meaningful while the pool is sweepable().
+*/
+template<typename Visitor>
+void NodePool::forEachLive(Visitor visit)
+{
+    freeList_ = sortByAddress(freeList_, freeTail_);
+    slabs_ = sortByAddress(slabs_, slabTail_);
+
+    const std::size_t header = roundUp(sizeof(Slab));
+    std::less<const char*> before;
+    FreeSlot* nextFree = freeList_;
+    for(Slab* slab = slabs_; slab != nullptr; slab = slab->next) {
+        char* slot = reinterpret_cast<char*>(slab) + header;
+        char* end = slot + slab->slots * slotSize_;
+        // Only the front of the slab being bumped has been handed out
+        if(slab == bumpSlab_) end = bump_;
+
+        for(; slot != end; slot += slotSize_) {
+            while(nextFree != nullptr && before(reinterpret_cast<char*>(nextFree), slot)) {
+                nextFree = nextFree->next;
+            }
+            if(reinterpret_cast<char*>(nextFree) == slot) {
+                nextFree = nextFree->next;
+                continue;
+            }
+            visit(static_cast<void*>(slot));
+        }
+    }
+}
+
+/**
+* Bottom-up merge sort of an intrusive singly linked list by node
+* address. Runs in O(n log n) time without recursion or extra memory.
+* Returns the new head and stores the new last link in tail.
+*/
+template<typename Link>
+Link* NodePool::sortByAddress(Link* head, Link*& tail)
+{
+    std::less<Link*> before;
+    for(std::size_t width = 1; ; width *= 2) {
+        Link* remaining = head;
+        Link* sorted = nullptr;
+        Link** append = &sorted;
+        std::size_t merges = 0;
+
+        while(remaining != nullptr) {
+            ++merges;
+            Link* a = remaining;
+            std::size_t aLen = 0;
+            while(remaining != nullptr && aLen < width) {
+                remaining = remaining->next;
+                ++aLen;
+            }
+            Link* b = remaining;
+            std::size_t bLen = 0;
+            while(remaining != nullptr && bLen < width) {
+                remaining = remaining->next;
+                ++bLen;
+            }
+
+            while(aLen > 0 || bLen > 0) {
+                Link* take;
+                if(bLen == 0 || (aLen > 0 && before(a, b))) {
+                    take = a;
+                    a = a->next;
+                    --aLen;
+                }
+                else {
+                    take = b;
+                    b = b->next;
+                    --bLen;
+                }
+                *append = take;
+                append = &take->next;
+            }
+        }
+        *append = nullptr;
+        head = sorted;
+        if(merges <= 1) {
+            tail = head;
+            while(tail != nullptr && tail->next != nullptr) tail = tail->next;
+            return head;
+        }
+    }
+}
+
+/**
+* Returns the (aligned) size of a single slot.
+*/
+inline std::size_t NodePool::slotSize() const
+{
+    return slotSize_;
+}
+
+/**
+* Returns true if every slot in this pool's slabs that is not on its free
+* list is live, which is what forEachLive relies on. That stops being
+* true once slots cross between pools through a non-splicing adopt().
+*/
+inline bool NodePool::sweepable() const
+{
+    return adopted_.empty() && !lent_;
+}
+
+/**
+* Returns the number of slabs currently owned by the pool.
+*/
+inline std::size_t NodePool::slabCount() const
+{
+    return slabCount_;
+}
+
+/**
+* Requests a new slab and makes it the bump region. Slabs double in
+* size up to MAX_SLAB_SLOTS so small trees stay small.
+*/
+inline void NodePool::addSlab()
+{
+    const std::size_t header = roundUp(sizeof(Slab));
+    char* raw = static_cast<char*>(::operator new(header + nextSlabSlots_ * slotSize_));
+    Slab* slab = reinterpret_cast<Slab*>(raw);
+    slab->next = slabs_;
+    slab->slots = nextSlabSlots_;
+    if(slabs_ == nullptr) slabTail_ = slab;
+    slabs_ = slab;
+    bumpSlab_ = slab;
+    ++slabCount_;
+
+    bump_ = raw + header;
+    bumpEnd_ = bump_ + nextSlabSlots_ * slotSize_;
+    if(nextSlabSlots_ < MAX_SLAB_SLOTS) nextSlabSlots_ *= 2;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,767 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <typename Key, typename Value, typename Compare>
+class PersistentAVLTree;
+
+/**
+ * A node of a PersistentAVLTree. A node may belong to several versions
+ * of the tree at once, so it has no parent pointer, and it counts the
+ * links (from trees and from parent nodes) that hold it. A node held by
+ * more than one link is never changed again; writers copy it instead.
+ */
+template <typename Key, typename Value>
+class PersistentAVLNode
+{
+public:
+    PersistentAVLNode(const Key& key, const Value& value);
+    PersistentAVLNode(const PersistentAVLNode<Key, Value>& other);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+    const PersistentAVLNode<Key, Value>* getLeft() const;
+    const PersistentAVLNode<Key, Value>* getRight() const;
+
+protected:
+    template <typename K, typename V, typename C>
+    friend class PersistentAVLTree;
+
+    std::pair<const Key, Value> item_;
+    PersistentAVLNode<Key, Value>* left_;
+    PersistentAVLNode<Key, Value>* right_;
+    int height_;
+    std::atomic<uint32_t> refs_;    // links holding this node; versions may live on other threads
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLNode class.
+  ------------------------------------------------------
+*/
+
+/**
+* Constructor for a leaf held by one link.
+*/
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const Key& key, const Value& value) :
+    item_(key, value),
+    left_(nullptr),
+    right_(nullptr),
+    height_(1),
+    refs_(1)
+{
+
+}
+
+/**
+* Copies a shared node so one version can change it. The copy holds
+* its own links to the same children.
+*/
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const PersistentAVLNode<Key, Value>& other) :
+    item_(other.item_),
+    left_(other.left_),
+    right_(other.right_),
+    height_(other.height_),
+    refs_(1)
+{
+    if(left_ != nullptr) left_->refs_.fetch_add(1, std::memory_order_relaxed);
+    if(right_ != nullptr) right_->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+* A getter for the item.
+*/
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+/**
+* A getter for the key.
+*/
+template<class Key, class Value>
+const Key& PersistentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+/**
+* A getter for the value.
+*/
+template<class Key, class Value>
+const Value& PersistentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+/**
+* A getter for the left child.
+*/
+template<class Key, class Value>
+const PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getLeft() const
+{
+    return left_;
+}
+
+/**
+* A getter for the right child.
+*/
+template<class Key, class Value>
+const PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLNode class.
+  ----------------------------------------------------
+*/
+
+/**
+ * An AVL tree whose versions share structure. snapshot() (or copying the
+ * tree) is O(1): the copy takes another link to the same root. A later
+ * insert or remove on either tree copies just the nodes on its search
+ * path that are still shared, O(log n) of them, and leaves every other
+ * version as it was. A tree that shares nothing updates in place, much
+ * like AVLTree.
+ *
+ * Different versions may be read and written from different threads at
+ * the same time, e.g. a snapshot being serialized while the live tree
+ * takes writes; link counts are atomic and shared nodes never change.
+ * One tree object is not safe to use from two threads at once.
+ *
+ * Items are read-only through iterators, since they may belong to other
+ * versions. Iterators keep the path from the root on a stack instead of
+ * climbing parent pointers, and stay valid until their tree changes.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+public:
+    typedef PersistentAVLNode<Key, Value> NodeType;
+
+    PersistentAVLTree();
+    explicit PersistentAVLTree(const Compare& comp);
+    PersistentAVLTree(const PersistentAVLTree<Key, Value, Compare>& other);
+    PersistentAVLTree(PersistentAVLTree<Key, Value, Compare>&& other);
+    PersistentAVLTree<Key, Value, Compare>& operator=(const PersistentAVLTree<Key, Value, Compare>& other);
+    PersistentAVLTree<Key, Value, Compare>& operator=(PersistentAVLTree<Key, Value, Compare>&& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree<Key, Value, Compare> snapshot() const;
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+
+    /**
+    * A read-only in-order iterator over one version of the tree.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeft(const NodeType* node);
+        std::vector<const NodeType*> path_;     // the current node on top, then ancestors still to visit
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+
+protected:
+    // Longer than any search path of an AVL tree that fits in memory
+    static const int MAX_HEIGHT = 96;
+
+    const NodeType* findNode(const Key& key) const;
+    static NodeType* own(NodeType*& link);
+    static void release(NodeType* node);
+    void retrace(NodeType** path[], int depth);
+    NodeType* rebalance(NodeType* node);
+    NodeType* rotateLeft(NodeType* node);
+    NodeType* rotateRight(NodeType* node);
+    static int heightOf(const NodeType* node);
+    static void updateHeight(NodeType* node);
+    static int checkHeights(const NodeType* node);
+
+protected:
+    NodeType* root_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+  ----------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  ----------------------------------------------------------------
+*/
+
+/**
+* A default constructor for an iterator at the end.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator()
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>& PersistentAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_.back()->getItem();
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>* PersistentAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_.back()->getItem());
+}
+
+/**
+* Checks if two iterators are at the same node (or both at the end).
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if(path_.empty() || rhs.path_.empty()) return path_.empty() == rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+/**
+* Checks if two iterators are at different nodes.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next key in order: the leftmost node of the right
+* subtree if there is one, otherwise the nearest ancestor still waiting
+* on the stack.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    if(path_.empty()) return *this;
+    const NodeType* node = path_.back();
+    path_.pop_back();
+    pushLeft(node->getRight());
+    return *this;
+}
+
+/**
+* Pushes node and its chain of left children, smallest on top.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::iterator::pushLeft(const NodeType* node)
+{
+    for(; node != nullptr; node = node->getLeft()) {
+        path_.push_back(node);
+    }
+}
+
+/*
+  --------------------------------------------------------------
+  End implementations for the PersistentAVLTree::iterator class.
+  --------------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree() :
+    root_(nullptr),
+    size_(0),
+    comp_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Copy constructor, in O(1): the copy shares every node with other.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree<Key, Value, Compare>& other) :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+    if(root_ != nullptr) root_->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+* Move constructor; other is left empty.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree<Key, Value, Compare>&& other) :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+/**
+* Copy assignment, in O(1) plus whatever nodes only this tree held.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree<Key, Value, Compare>& other)
+{
+    if(other.root_ != nullptr) other.root_->refs_.fetch_add(1, std::memory_order_relaxed);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    return *this;
+}
+
+/**
+* Move assignment; other is left empty.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree<Key, Value, Compare>&& other)
+{
+    if(&other == this) return *this;
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    other.root_ = nullptr;
+    other.size_ = 0;
+    return *this;
+}
+
+/**
+* Destructor; frees the nodes no other version holds.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Returns a version of the tree frozen at this point, in O(1). Changes to
+* either tree from now on do not show up in the other.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return PersistentAVLTree<Key, Value, Compare>(*this);
+}
+
+/**
+* Inserts the pair, or replaces the value if the key is already there.
+* Shared nodes on the way down are copied into their parents' links as
+* the search passes them, so if a copy throws the tree still holds the
+* same keys and values.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    NodeType** path[MAX_HEIGHT];
+    int depth = 0;
+    NodeType** link = &root_;
+    while(*link != nullptr) {
+        NodeType* node = own(*link);
+        path[depth++] = link;
+        if(comp_(keyValuePair.first, node->getKey())) {
+            link = &node->left_;
+        }
+        else if(comp_(node->getKey(), keyValuePair.first)) {
+            link = &node->right_;
+        }
+        else {
+            node->item_.second = keyValuePair.second;
+            return;
+        }
+    }
+    *link = new NodeType(keyValuePair.first, keyValuePair.second);
+    ++size_;
+    retrace(path, depth);
+}
+
+/**
+* Removes key if it is there; nothing is copied when it is not. A node
+* with two children is replaced by the smallest node of its right
+* subtree, which is moved rather than copied into place.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    if(findNode(key) == nullptr) return;
+
+    NodeType** path[MAX_HEIGHT];
+    int depth = 0;
+    NodeType** link = &root_;
+    while(true) {
+        NodeType* node = *link;
+        if(comp_(key, node->getKey())) {
+            path[depth++] = link;
+            link = &own(*link)->left_;
+        }
+        else if(comp_(node->getKey(), key)) {
+            path[depth++] = link;
+            link = &own(*link)->right_;
+        }
+        else {
+            break;
+        }
+    }
+
+    NodeType* node = *link;
+    if(node->left_ == nullptr || node->right_ == nullptr) {
+        // The child gets a link of its own, since node may live on elsewhere
+        NodeType* child = node->left_ != nullptr ? node->left_ : node->right_;
+        if(child != nullptr) child->refs_.fetch_add(1, std::memory_order_relaxed);
+        *link = child;
+        release(node);
+    }
+    else {
+        // The successor's slot below shrinks, then it takes node's place
+        node = own(*link);
+        path[depth++] = link;
+        int first = depth;
+        NodeType** spine = &node->right_;
+        own(*spine);
+        while((*spine)->left_ != nullptr) {
+            path[depth++] = spine;
+            spine = &(*spine)->left_;
+            own(*spine);
+        }
+        NodeType* successor = *spine;
+        *spine = successor->right_;
+        successor->left_ = node->left_;
+        successor->right_ = node->right_;
+        successor->height_ = node->height_;
+        *link = successor;
+        // The first link of the spine was in node; it is successor's now
+        if(depth > first) path[first] = &successor->right_;
+        node->left_ = nullptr;
+        node->right_ = nullptr;
+        release(node);
+    }
+    --size_;
+    retrace(path, depth);
+}
+
+/**
+* Empties this version; other versions keep their nodes.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Returns the number of keys in O(1).
+*/
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns true if the tree is empty.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+* Returns true if every node's children differ in height by at most one.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkHeights(root_) >= 0;
+}
+
+/**
+* Returns an iterator to the smallest key.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeft(root_);
+    return it;
+}
+
+/**
+* Returns an iterator past the largest key.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with key, or end() if there is none.
+* The stack keeps the ancestors that come after key in order.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it;
+    const NodeType* node = root_;
+    while(node != nullptr) {
+        if(comp_(key, node->getKey())) {
+            it.path_.push_back(node);
+            node = node->getLeft();
+        }
+        else if(comp_(node->getKey(), key)) {
+            node = node->getRight();
+        }
+        else {
+            it.path_.push_back(node);
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+const Value& PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const NodeType* node = findNode(key);
+    if(node == nullptr) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+/**
+* Returns the node with key, or NULL.
+*/
+template<class Key, class Value, class Compare>
+const typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    const NodeType* node = root_;
+    while(node != nullptr) {
+        if(comp_(key, node->getKey())) node = node->getLeft();
+        else if(comp_(node->getKey(), key)) node = node->getRight();
+        else return node;
+    }
+    return nullptr;
+}
+
+/**
+* Makes the node that link (one of ours) points to safe to change: it
+* is returned as is if no one else holds it, otherwise link is moved to
+* a copy of it.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::own(NodeType*& link)
+{
+    // Only holders can add links, so a count of one cannot grow under us
+    if(link->refs_.load(std::memory_order_acquire) == 1) return link;
+    NodeType* copy = new NodeType(*link);
+    release(link);
+    link = copy;
+    return copy;
+}
+
+/**
+* Gives up one link to node, freeing it (and then its children's links)
+* if it was the last. Works through a list rather than recursing.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(NodeType* node)
+{
+    std::vector<NodeType*> pending;
+    while(node != nullptr) {
+        if(node->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if(node->left_ != nullptr) pending.push_back(node->left_);
+            if(node->right_ != nullptr) pending.push_back(node->right_);
+            delete node;
+        }
+        if(pending.empty()) break;
+        node = pending.back();
+        pending.pop_back();
+    }
+}
+
+/**
+* Rebalances the subtrees at the links in path, deepest first, after
+* the one below the last of them grew or shrank. Stops as soon as a
+* subtree is as tall as it was.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::retrace(NodeType** path[], int depth)
+{
+    while(depth > 0) {
+        NodeType** link = path[--depth];
+        int before = (*link)->height_;
+        *link = rebalance(*link);
+        if((*link)->height_ == before) return;
+    }
+}
+
+/**
+* Updates the height of an unshared node, rotating if its children differ
+* in height by two. Returns the root of the subtree.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::rebalance(NodeType* node)
+{
+    int balance = heightOf(node->left_) - heightOf(node->right_);
+    if(balance > 1) {
+        if(heightOf(node->left_->left_) < heightOf(node->left_->right_)) {
+            node->left_ = rotateLeft(own(node->left_));
+        }
+        return rotateRight(node);
+    }
+    if(balance < -1) {
+        if(heightOf(node->right_->right_) < heightOf(node->right_->left_)) {
+            node->right_ = rotateRight(own(node->right_));
+        }
+        return rotateLeft(node);
+    }
+    updateHeight(node);
+    return node;
+}
+
+/**
+* Rotates an unshared node down to the left, copying its right child if
+* that is shared. The links just change hands, so no count changes.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::rotateLeft(NodeType* node)
+{
+    NodeType* pivot = own(node->right_);
+    node->right_ = pivot->left_;
+    pivot->left_ = node;
+    updateHeight(node);
+    updateHeight(pivot);
+    return pivot;
+}
+
+/**
+* Rotates an unshared node down to the right; see rotateLeft.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+PersistentAVLTree<Key, Value, Compare>::rotateRight(NodeType* node)
+{
+    NodeType* pivot = own(node->left_);
+    node->left_ = pivot->right_;
+    pivot->right_ = node;
+    updateHeight(node);
+    updateHeight(pivot);
+    return pivot;
+}
+
+/**
+* Returns the height of a subtree (0 if empty).
+*/
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::heightOf(const NodeType* node)
+{
+    return node == nullptr ? 0 : node->height_;
+}
+
+/**
+* Recomputes node's height from its children.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::updateHeight(NodeType* node)
+{
+    int left = heightOf(node->left_);
+    int right = heightOf(node->right_);
+    node->height_ = 1 + (left > right ? left : right);
+}
+
+/**
+* Returns the height of a subtree if every node in it is balanced and
+* has its height stored correctly, or -1 if not.
+*/
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::checkHeights(const NodeType* node)
+{
+    if(node == nullptr) return 0;
+    int left = checkHeights(node->left_);
+    int right = checkHeights(node->right_);
+    if(left < 0 || right < 0 || left - right > 1 || right - left > 1) return -1;
+    int height = 1 + (left > right ? left : right);
+    return height == node->height_ ? height : -1;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A node of a red-black tree: a Node plus its color.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    RBNode(Key&& key, Value&& value, RBNode<Key, Value>* parent);
+    ~RBNode();
+
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Hide the Node getters, as AVLNode does; see the Node class in bst.h.
+    RBNode<Key, Value>* getParent() const;
+    RBNode<Key, Value>* getLeft() const;
+    RBNode<Key, Value>* getRight() const;
+
+protected:
+    bool red_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the RBNode class.
+  ---------------------------------------------
+*/
+
+/**
+* Constructor for a red node, which is what every new node starts as.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), red_(true)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(Key&& key, Value&& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), red_(true)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+/**
+* Returns true if the node is red, false if it is black.
+*/
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return red_;
+}
+
+/**
+* Colors the node red (true) or black (false).
+*/
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    red_ = red;
+}
+
+/**
+* A getter for the parent that hides Node::getParent.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  -------------------------------------------
+  End implementations for the RBNode class.
+  -------------------------------------------
+*/
+
+/**
+* A red-black tree. Every path from a node down to an empty slot passes
+* the same number of black nodes, and no red node has a red child, so
+* the tree is at most twice as deep as a perfect one. It is looser than
+* an AVL tree, and pays for that with slightly deeper searches, but a
+* removal makes at most three rotations, where an AVL tree may rotate at
+* every level on the way up.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class RedBlackTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    RedBlackTree();
+    explicit RedBlackTree(const Compare& comp);
+    template<typename InputIterator>
+    RedBlackTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual ~RedBlackTree();
+    bool isValid() const;
+
+protected:
+    virtual void nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* buildBalanced(std::vector<std::pair<Key, Value> >& items,
+        std::size_t lo, std::size_t hi, Node<Key, Value>* parent);
+
+    static bool isRed(const RBNode<Key, Value>* node);
+    void insertFix(RBNode<Key, Value>* node);
+    void removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent);
+    static void paintBottom(RBNode<Key, Value>* node, int depth, int bottom);
+    static int blackHeight(const RBNode<Key, Value>* node);
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the RedBlackTree class.
+  ---------------------------------------------------
+*/
+
+/**
+* Default constructor; sizes the node pool for RBNodes.
+*/
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), Compare())
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), comp)
+{
+
+}
+
+/**
+* Range constructor; see BinarySearchTree::bulkLoad.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), comp)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Destructor; clears here so that destroyNode still runs ~RBNode.
+*/
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::~RedBlackTree()
+{
+    this->clear();
+}
+
+/**
+* Returns true if the root is black, no red node has a red child and
+* every path to an empty slot has the same number of black nodes.
+*/
+template<class Key, class Value, class Compare>
+bool RedBlackTree<Key, Value, Compare>::isValid() const
+{
+    const RBNode<Key, Value>* root = static_cast<RBNode<Key, Value>*>(this->root_);
+    return !isRed(root) && blackHeight(root) >= 0;
+}
+
+/**
+* Trades the places of two nodes, and their colors with them, since a
+* color belongs to the position.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2)
+{
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    bool red = n1->isRed();
+    n1->setRed(n2->isRed());
+    n2->setRed(red);
+}
+
+/**
+* Destroys an RBNode and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<RBNode<Key, Value>*>(node)->~RBNode();
+    this->pool_->deallocate(node);
+}
+
+/**
+* Creates an RBNode for the inserts of the base class.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::makeNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    return this->createNode(std::move(key), std::move(value), static_cast<RBNode<Key, Value>*>(parent));
+}
+
+/**
+* Hangs a new red leaf below parent and repairs the colors above it.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(node, parent, goLeft);
+    insertFix(static_cast<RBNode<Key, Value>*>(node));
+}
+
+/**
+* Unlinks a node. As in the other trees, a node with two children first
+* swaps places with its predecessor. Taking out a red node, or a black
+* one with a red child to paint black, changes no black counts; anything
+* else leaves the paths through its slot one black short, which
+* removeFix makes up for.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::removeNode(Node<Key, Value>* removed)
+{
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(removed);
+    if(node->getLeft() != nullptr && node->getRight() != nullptr) {
+        RBNode<Key, Value>* pred = static_cast<RBNode<Key, Value>*>(this->predecessor(node));
+        nodeSwap(pred, node);
+        if(this->threaded_) node->setSuccessorThread(pred);
+    }
+
+    RBNode<Key, Value>* parent = node->getParent();
+    RBNode<Key, Value>* child = node->getLeft() ? node->getLeft() : node->getRight();
+    if(child != nullptr) child->setParent(parent);
+    if(parent == nullptr) {
+        this->root_ = child;
+    }
+    else if(parent->getLeft() == node) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+
+    bool wasRed = node->isRed();
+    this->threadPast(node);
+    this->uncache(node);
+    destroyNode(node);
+
+    if(wasRed) return;
+    if(isRed(child)) child->setRed(false);
+    else removeFix(child, parent);
+}
+
+/**
+* Builds a balanced subtree of RBNodes from items[lo, hi). Every level
+* but the last of such a tree is full, so the outermost call colors the
+* last level red, unless it is full too, and everything else black.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::buildBalanced(std::vector<std::pair<Key, Value> >& items,
+    std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if(lo >= hi) return nullptr;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(
+        makeNode(std::move(items[mid].first), std::move(items[mid].second), parent));
+    node->setRed(false);
+    node->setLeft(buildBalanced(items, lo, mid, node));
+    node->setRight(buildBalanced(items, mid + 1, hi, node));
+
+    if(parent == nullptr) {
+        int levels = 0;
+        for(std::size_t size = hi - lo; size != 0; size >>= 1) ++levels;
+        if(hi - lo + 1 != std::size_t(1) << levels) paintBottom(node, 0, levels - 1);
+    }
+    return node;
+}
+
+/**
+* Returns true for a red node; empty slots count as black.
+*/
+template<class Key, class Value, class Compare>
+bool RedBlackTree<Key, Value, Compare>::isRed(const RBNode<Key, Value>* node)
+{
+    return node != nullptr && node->isRed();
+}
+
+/**
+* Restores the rules after node was linked in red: while its parent is
+* red too, either recolor (a red uncle) and go up two levels, or rotate
+* once or twice (a black uncle) and stop.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::insertFix(RBNode<Key, Value>* node)
+{
+    while(isRed(node->getParent())) {
+        RBNode<Key, Value>* parent = node->getParent();
+        // A red parent is never the root, so there is a grandparent
+        RBNode<Key, Value>* grandparent = parent->getParent();
+        if(parent == grandparent->getLeft()) {
+            RBNode<Key, Value>* uncle = grandparent->getRight();
+            if(isRed(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                continue;
+            }
+            if(node == parent->getRight()) {
+                this->rotateLeft(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setRed(false);
+            grandparent->setRed(true);
+            this->rotateRight(grandparent);
+        } else {
+            RBNode<Key, Value>* uncle = grandparent->getLeft();
+            if(isRed(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                continue;
+            }
+            if(node == parent->getLeft()) {
+                this->rotateRight(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setRed(false);
+            grandparent->setRed(true);
+            this->rotateLeft(grandparent);
+        }
+        break;
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setRed(false);
+}
+
+/**
+* Makes up for the missing black on the paths through node, a black
+* node or an empty slot below parent. Recoloring a black sibling red
+* moves the shortage up a level; otherwise one to three rotations
+* settle it.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent)
+{
+    while(parent != nullptr && !isRed(node)) {
+        if(node == parent->getLeft()) {
+            // node is one black short, so its sibling has a black below it and exists
+            RBNode<Key, Value>* sibling = parent->getRight();
+            if(sibling->isRed()) {
+                sibling->setRed(false);
+                parent->setRed(true);
+                this->rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if(!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if(!isRed(sibling->getRight())) {
+                sibling->getLeft()->setRed(false);
+                sibling->setRed(true);
+                this->rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getRight()->setRed(false);
+            this->rotateLeft(parent);
+        } else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if(sibling->isRed()) {
+                sibling->setRed(false);
+                parent->setRed(true);
+                this->rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if(!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if(!isRed(sibling->getLeft())) {
+                sibling->getRight()->setRed(false);
+                sibling->setRed(true);
+                this->rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getLeft()->setRed(false);
+            this->rotateRight(parent);
+        }
+        node = static_cast<RBNode<Key, Value>*>(this->root_);
+        break;
+    }
+    if(node != nullptr) node->setRed(false);
+}
+
+/**
+* Colors the nodes at the given depth below node red.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::paintBottom(RBNode<Key, Value>* node, int depth, int bottom)
+{
+    if(node == nullptr) return;
+    if(depth == bottom) {
+        node->setRed(true);
+        return;
+    }
+    paintBottom(node->getLeft(), depth + 1, bottom);
+    paintBottom(node->getRight(), depth + 1, bottom);
+}
+
+/**
+* Returns the number of black nodes on every path from node to an empty
+* slot, or -1 if the paths disagree or a red node has a red child.
+*/
+template<class Key, class Value, class Compare>
+int RedBlackTree<Key, Value, Compare>::blackHeight(const RBNode<Key, Value>* node)
+{
+    if(node == nullptr) return 0;
+    if(node->isRed() && (isRed(node->getLeft()) || isRed(node->getRight()))) return -1;
+    int left = blackHeight(node->getLeft());
+    int right = blackHeight(node->getRight());
+    if(left < 0 || left != right) return -1;
+    return left + (node->isRed() ? 0 : 1);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the RedBlackTree class.
+  -------------------------------------------------
+*/
+
+#endif
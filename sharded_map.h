@@ -0,0 +1,443 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+ * A map split across N independent AVLTrees ("shards"), each behind its
+ * own mutex, so writers on different shards never wait for each other.
+ * A key's shard is picked by hashing it; the hash is mixed first, so
+ * hashes that are not spread out (std::hash of an integer is the integer
+ * itself) still fill the shards evenly.
+ *
+ * insert, remove, find, contains and operator[] lock one shard and are
+ * safe from any number of threads. size, empty and clear lock each shard
+ * in turn. Iteration merges the shards into one ordered sequence through
+ * a heap of per-shard cursors; it takes no locks, so nothing may write
+ * to the map while an iterator is in use.
+ */
+template <typename Key, typename Value, std::size_t N, typename Compare = std::less<Key>,
+    typename Hash = std::hash<Key> >
+class ShardedMap
+{
+    static_assert(N > 0, "ShardedMap needs at least one shard");
+
+public:
+    ShardedMap();
+    explicit ShardedMap(const Compare& comp, const Hash& hash = Hash());
+
+    ShardedMap(const ShardedMap&) = delete;
+    ShardedMap& operator=(const ShardedMap&) = delete;
+
+    // Lock one shard
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+
+    // Lock every shard, one at a time
+    std::size_t size() const;
+    bool empty() const;
+    void clear();
+    template<typename InputIterator>
+    void bulkLoad(InputIterator first, InputIterator last);
+
+    std::size_t shardOf(const Key& key) const;
+
+protected:
+    typedef AVLTree<Key, Value, Compare> Tree;
+    typedef typename Tree::iterator TreeIterator;
+
+public:
+    /**
+    * Walks every shard's keys in one ascending sequence.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedMap<Key, Value, N, Compare, Hash>;
+
+        // Where one shard's walk has got to
+        struct Cursor
+        {
+            TreeIterator current;
+            TreeIterator end;
+        };
+
+        // Orders the heap so the cursor with the smallest key is on top
+        struct Later
+        {
+            explicit Later(const Compare* comp) : comp_(comp) {}
+            bool operator()(const Cursor& a, const Cursor& b) const
+            {
+                return (*comp_)(b.current->first, a.current->first);
+            }
+            const Compare* comp_;
+        };
+
+        explicit iterator(const ShardedMap<Key, Value, N, Compare, Hash>* map);
+        std::vector<Cursor> heap_;
+        const Compare* comp_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    // Padded so the mutexes of neighbouring shards do not share a line
+    struct Shard
+    {
+        explicit Shard(const Compare& comp) : tree(comp) {}
+        mutable std::mutex lock;
+        Tree tree;
+        char padding[64];
+    };
+
+    Shard& shardFor(const Key& key) const;
+
+protected:
+    std::vector<std::unique_ptr<Shard> > shards_;
+    Compare comp_;
+    Hash hash_;
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the ShardedMap::iterator class.
+  -----------------------------------------------------------
+*/
+
+/**
+* Constructor for the end of any map.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+ShardedMap<Key, Value, N, Compare, Hash>::iterator::iterator() :
+    comp_(nullptr)
+{
+
+}
+
+/**
+* Starts a walk at the smallest key of every shard.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+ShardedMap<Key, Value, N, Compare, Hash>::iterator::iterator(const ShardedMap<Key, Value, N, Compare, Hash>* map) :
+    comp_(&map->comp_)
+{
+    heap_.reserve(N);
+    for(std::size_t i = 0; i < N; ++i) {
+        const Tree& tree = map->shards_[i]->tree;
+        Cursor cursor = { tree.begin(), tree.end() };
+        if(cursor.current != cursor.end) heap_.push_back(cursor);
+    }
+    std::make_heap(heap_.begin(), heap_.end(), Later(comp_));
+}
+
+/**
+* Dereferences the iterator.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+std::pair<const Key, Value>& ShardedMap<Key, Value, N, Compare, Hash>::iterator::operator*() const
+{
+    return *heap_.front().current;
+}
+
+/**
+* Dereferences the iterator.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+std::pair<const Key, Value>* ShardedMap<Key, Value, N, Compare, Hash>::iterator::operator->() const
+{
+    return &**this;
+}
+
+/**
+* Checks if 'this' iterator's internals have the same value
+* as 'rhs'
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+bool ShardedMap<Key, Value, N, Compare, Hash>::iterator::operator==(const iterator& rhs) const
+{
+    if(heap_.empty() || rhs.heap_.empty()) return heap_.empty() == rhs.heap_.empty();
+    return heap_.front().current == rhs.heap_.front().current;
+}
+
+/**
+* Checks if 'this' iterator's internals have a different value
+* as 'rhs'
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+bool ShardedMap<Key, Value, N, Compare, Hash>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the shard with the smallest key and puts it back in the heap,
+* O(log N).
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+typename ShardedMap<Key, Value, N, Compare, Hash>::iterator&
+ShardedMap<Key, Value, N, Compare, Hash>::iterator::operator++()
+{
+    std::pop_heap(heap_.begin(), heap_.end(), Later(comp_));
+    Cursor& cursor = heap_.back();
+    ++cursor.current;
+    if(cursor.current == cursor.end) heap_.pop_back();
+    else std::push_heap(heap_.begin(), heap_.end(), Later(comp_));
+    return *this;
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the ShardedMap::iterator class.
+  ---------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the ShardedMap class.
+  -----------------------------------------------
+*/
+
+/**
+* Default constructor for an empty map.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+ShardedMap<Key, Value, N, Compare, Hash>::ShardedMap() :
+    comp_(),
+    hash_()
+{
+    for(std::size_t i = 0; i < N; ++i) shards_.push_back(std::unique_ptr<Shard>(new Shard(comp_)));
+}
+
+/**
+* Constructor for an empty map ordered by comp and sharded by hash.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+ShardedMap<Key, Value, N, Compare, Hash>::ShardedMap(const Compare& comp, const Hash& hash) :
+    comp_(comp),
+    hash_(hash)
+{
+    for(std::size_t i = 0; i < N; ++i) shards_.push_back(std::unique_ptr<Shard>(new Shard(comp_)));
+}
+
+/**
+* Inserts the pair, or replaces the value if the key is already there.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+void ShardedMap<Key, Value, N, Compare, Hash>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Shard& shard = shardFor(keyValuePair.first);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.tree.insert(keyValuePair);
+}
+
+/**
+* Removes key if it is there.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+void ShardedMap<Key, Value, N, Compare, Hash>::remove(const Key& key)
+{
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.tree.remove(key);
+}
+
+/**
+* Copies the value stored with key into value and returns true, or
+* returns false if the key is not in the map.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+bool ShardedMap<Key, Value, N, Compare, Hash>::find(const Key& key, Value& value) const
+{
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    TreeIterator it = shard.tree.find(key);
+    if(it == shard.tree.end()) return false;
+    value = it->second;
+    return true;
+}
+
+/**
+* Returns true if the key is in the map.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+bool ShardedMap<Key, Value, N, Compare, Hash>::contains(const Key& key) const
+{
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.tree.find(key) != shard.tree.end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key
+ */
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+Value ShardedMap<Key, Value, N, Compare, Hash>::operator[](const Key& key) const
+{
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    const Tree& tree = shard.tree;
+    return tree[key];
+}
+
+/**
+* Returns the number of keys. With writers running, each shard is
+* counted at a slightly different moment.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+std::size_t ShardedMap<Key, Value, N, Compare, Hash>::size() const
+{
+    std::size_t total = 0;
+    for(std::size_t i = 0; i < N; ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        total += shards_[i]->tree.size();
+    }
+    return total;
+}
+
+/**
+* Returns true if no shard holds a key.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+bool ShardedMap<Key, Value, N, Compare, Hash>::empty() const
+{
+    for(std::size_t i = 0; i < N; ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        if(!shards_[i]->tree.empty()) return false;
+    }
+    return true;
+}
+
+/**
+* Removes every key.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+void ShardedMap<Key, Value, N, Compare, Hash>::clear()
+{
+    for(std::size_t i = 0; i < N; ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->lock);
+        shards_[i]->tree.clear();
+    }
+}
+
+/**
+* Replaces the contents of the map with the pairs in [first, last). The
+* pairs are dealt out to their shards, and then the shards are built at
+* the same time, each on its own thread (or on this one if no thread can
+* be started) with AVLTree::bulkLoad. As with insert, when a key appears
+* more than once the last value wins.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+template<typename InputIterator>
+void ShardedMap<Key, Value, N, Compare, Hash>::bulkLoad(InputIterator first, InputIterator last)
+{
+    std::vector<std::vector<std::pair<Key, Value> > > parts(N);
+    for(; first != last; ++first) {
+        parts[shardOf(first->first)].push_back(*first);
+    }
+
+    std::vector<std::future<void> > tasks;
+    tasks.reserve(N);
+    std::size_t i = 0;
+    try {
+        for(; i < N; ++i) {
+            Shard* shard = shards_[i].get();
+            std::vector<std::pair<Key, Value> >* part = &parts[i];
+            try {
+                tasks.push_back(std::async(std::launch::async, [shard, part]() {
+                    std::lock_guard<std::mutex> guard(shard->lock);
+                    shard->tree.bulkLoad(part->begin(), part->end());
+                }));
+            }
+            catch(const std::system_error&) {
+                // Out of threads; this thread builds the rest
+                break;
+            }
+        }
+        for(; i < N; ++i) {
+            std::lock_guard<std::mutex> guard(shards_[i]->lock);
+            shards_[i]->tree.bulkLoad(parts[i].begin(), parts[i].end());
+        }
+    }
+    catch(...) {
+        for(std::size_t t = 0; t < tasks.size(); ++t) tasks[t].wait();
+        throw;
+    }
+    for(std::size_t t = 0; t < tasks.size(); ++t) tasks[t].get();
+}
+
+/**
+* Returns the index of the shard that holds key. The hash is multiplied
+* by a large odd constant (Fibonacci hashing) and the high bits picked,
+* so even sequential integers spread across all shards.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+std::size_t ShardedMap<Key, Value, N, Compare, Hash>::shardOf(const Key& key) const
+{
+    uint64_t mixed = static_cast<uint64_t>(hash_(key)) * UINT64_C(0x9E3779B97F4A7C15);
+    return static_cast<std::size_t>((mixed >> 32) % N);
+}
+
+/**
+* Returns the shard that holds key.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+typename ShardedMap<Key, Value, N, Compare, Hash>::Shard&
+ShardedMap<Key, Value, N, Compare, Hash>::shardFor(const Key& key) const
+{
+    return *shards_[shardOf(key)];
+}
+
+/**
+* Returns an iterator to the smallest key of the whole map. No thread
+* may write to the map while it is in use.
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+typename ShardedMap<Key, Value, N, Compare, Hash>::iterator
+ShardedMap<Key, Value, N, Compare, Hash>::begin() const
+{
+    return iterator(this);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, std::size_t N, class Compare, class Hash>
+typename ShardedMap<Key, Value, N, Compare, Hash>::iterator
+ShardedMap<Key, Value, N, Compare, Hash>::end() const
+{
+    return iterator();
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedMap class.
+  ---------------------------------------------
+*/
+
+#endif
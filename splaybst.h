@@ -0,0 +1,343 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "bst.h"
+
+/**
+* A splay tree: a search tree that keeps no balance data at all, but
+* rotates each key it touches up towards the root, so keys used often
+* stay a few levels down and a working set of k keys costs O(log k) per
+* lookup, however large the tree. Any sequence of m operations takes
+* O(m log n) in total, though a single one may be slow. Since a node
+* needs nothing beyond its key and value, the tree is built from plain
+* Nodes.
+*
+* Lookups through a non-const tree restructure it; through a const one
+* they are plain searches, as in BinarySearchTree. Two options trade
+* some of the adjustment away for fewer writes:
+* - semi-splaying moves a key about halfway to the root instead of all
+*   the way, which roughly halves the rotations per access;
+* - a splay interval of k splays only every k-th find, so a read-mostly
+*   workload writes to the tree on a fraction of its lookups.
+* Inserts always splay the new key, and removals splay the node above
+* the one unlinked.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class SplayTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    SplayTree();
+    explicit SplayTree(const Compare& comp);
+    template<typename InputIterator>
+    SplayTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual ~SplayTree();
+
+    // The const lookups of the base class stay available for const trees
+    using BinarySearchTree<Key, Value, Compare>::find;
+    using BinarySearchTree<Key, Value, Compare>::operator[];
+    typename BinarySearchTree<Key, Value, Compare>::iterator find(const Key& key);
+    Value& operator[](const Key& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    typename BinarySearchTree<Key, Value, Compare>::iterator find(const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value& operator[](const K& key);
+
+    void setSemiSplay(bool semi);
+    bool semiSplay() const;
+    void setSplayInterval(unsigned interval);
+    unsigned splayInterval() const;
+
+    // What the lookups have done since the tree was built or the
+    // counters were last reset
+    struct SplayStats
+    {
+        uint64_t finds;         // lookups through find and operator[]
+        uint64_t splays;        // splays, from lookups, inserts and removals
+        uint64_t rotations;     // single rotations made by those splays
+    };
+    const SplayStats& splayStats() const;
+    void resetSplayStats();
+
+protected:
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual void removeNode(Node<Key, Value>* node);
+
+    template<typename K>
+    Node<Key, Value>* access(const K& key);
+    void splay(Node<Key, Value>* node);
+    void rotateUp(Node<Key, Value>* node);
+
+protected:
+    bool semi_;                 // semi-splay instead of splaying to the root
+    unsigned splayInterval_;    // splay on every splayInterval_-th find
+    unsigned sinceSplay_;       // finds since the last one that splayed
+    SplayStats splayStats_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the SplayTree class.
+  ------------------------------------------------
+*/
+
+/**
+* Default constructor; the tree splays fully on every access.
+*/
+template<class Key, class Value, class Compare>
+SplayTree<Key, Value, Compare>::SplayTree() :
+    BinarySearchTree<Key, Value, Compare>(Compare()),
+    semi_(false), splayInterval_(1), sinceSplay_(0), splayStats_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+SplayTree<Key, Value, Compare>::SplayTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp),
+    semi_(false), splayInterval_(1), sinceSplay_(0), splayStats_()
+{
+
+}
+
+/**
+* Range constructor; see BinarySearchTree::bulkLoad. The tree starts out
+* perfectly balanced.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+SplayTree<Key, Value, Compare>::SplayTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp),
+    semi_(false), splayInterval_(1), sinceSplay_(0), splayStats_()
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* A destructor which does nothing; the nodes are plain Nodes, which the
+* base class destroys.
+*/
+template<class Key, class Value, class Compare>
+SplayTree<Key, Value, Compare>::~SplayTree()
+{
+
+}
+
+/**
+* Returns an iterator to key, or end() if it is not in the tree, and
+* splays the last node the search reached (subject to the splay
+* interval).
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator SplayTree<Key, Value, Compare>::find(const Key& key)
+{
+    return this->iteratorAt(access(key));
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key, splaying as find does.
+*/
+template<class Key, class Value, class Compare>
+Value& SplayTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node<Key, Value>* node = access(key);
+    if(node == nullptr) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+/**
+* Heterogeneous find; see BinarySearchTree::find(const K&).
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator SplayTree<Key, Value, Compare>::find(const K& key)
+{
+    return this->iteratorAt(access(key));
+}
+
+/**
+* @precondition The key exists in the map
+* Heterogeneous version of operator[]; see find(const K&).
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+Value& SplayTree<Key, Value, Compare>::operator[](const K& key)
+{
+    Node<Key, Value>* node = access(key);
+    if(node == nullptr) throw std::out_of_range("Invalid key");
+    return node->getValue();
+}
+
+/**
+* Chooses between splaying each accessed key to the root (the default)
+* and semi-splaying it.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::setSemiSplay(bool semi)
+{
+    semi_ = semi;
+}
+
+/**
+* Returns true if accesses semi-splay.
+*/
+template<class Key, class Value, class Compare>
+bool SplayTree<Key, Value, Compare>::semiSplay() const
+{
+    return semi_;
+}
+
+/**
+* Makes only every interval-th find splay; the others leave the tree as
+* it is. 1 (the default) splays on every find, and 0 is taken as 1.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::setSplayInterval(unsigned interval)
+{
+    splayInterval_ = interval == 0 ? 1 : interval;
+    sinceSplay_ = 0;
+}
+
+/**
+* Returns how many finds there are per splay.
+*/
+template<class Key, class Value, class Compare>
+unsigned SplayTree<Key, Value, Compare>::splayInterval() const
+{
+    return splayInterval_;
+}
+
+/**
+* Returns the lookup counters, from which the rotations per lookup (the
+* writes a splay tree adds to its reads) follow.
+*/
+template<class Key, class Value, class Compare>
+const typename SplayTree<Key, Value, Compare>::SplayStats& SplayTree<Key, Value, Compare>::splayStats() const
+{
+    return splayStats_;
+}
+
+/**
+* Zeroes the lookup counters.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::resetSplayStats()
+{
+    splayStats_ = SplayStats();
+}
+
+/**
+* Hangs a new leaf below parent, then splays it to the root.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(node, parent, goLeft);
+    splay(node);
+}
+
+/**
+* Unlinks the node as the base class does, then splays the node that
+* was above the slot it left: its own parent, or for a node with two
+* children, the parent of the predecessor that takes its place (which
+* is the node itself if the predecessor was its left child, in which
+* case the predecessor is splayed).
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::removeNode(Node<Key, Value>* node)
+{
+    Node<Key, Value>* above = node->getParent();
+    if(node->getLeft() != nullptr && node->getRight() != nullptr) {
+        Node<Key, Value>* pred = this->predecessor(node);
+        above = pred->getParent() == node ? pred : pred->getParent();
+    }
+    BinarySearchTree<Key, Value, Compare>::removeNode(node);
+    if(above != nullptr) splay(above);
+}
+
+/**
+* Searches for key, stopping as soon as it is found, and returns its
+* node or nullptr. Every splay-interval-th call then splays the last
+* node the search visited, the key's own or, on a miss, the one where
+* the search fell off the tree, so that misses pay for their descent as
+* well.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* SplayTree<Key, Value, Compare>::access(const K& key)
+{
+    ++splayStats_.finds;
+    Node<Key, Value>* current = this->root_;
+    Node<Key, Value>* last = nullptr;
+    while(current != nullptr) {
+        last = current;
+        if(this->comp_(key, current->getKey())) current = current->getLeft();
+        else if(this->comp_(current->getKey(), key)) current = current->getRight();
+        else break;
+    }
+    if(last != nullptr && ++sinceSplay_ >= splayInterval_) {
+        sinceSplay_ = 0;
+        splay(last);
+    }
+    return current;
+}
+
+/**
+* Moves node up by pairs of rotations. When node and its parent are
+* children on the same side (zig-zig), the parent is rotated over the
+* grandparent first and then node over the parent; when on opposite
+* sides (zig-zag), node is rotated up twice; a node just below the root
+* takes one rotation (zig). Every step about halves the depth of the
+* nodes on the search path, which is what pays for long searches.
+* Semi-splaying does only the first rotation of a zig-zig step and
+* carries on from the parent, leaving node about halfway up.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::splay(Node<Key, Value>* node)
+{
+    ++splayStats_.splays;
+    while(node->getParent() != nullptr) {
+        Node<Key, Value>* parent = node->getParent();
+        Node<Key, Value>* grand = parent->getParent();
+        if(grand == nullptr) {
+            rotateUp(node);
+        }
+        else if((node == parent->getLeft()) == (parent == grand->getLeft())) {
+            rotateUp(parent);
+            if(semi_) node = parent;
+            else rotateUp(node);
+        }
+        else {
+            rotateUp(node);
+            rotateUp(node);
+        }
+    }
+}
+
+/**
+* Rotates node over its parent.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::rotateUp(Node<Key, Value>* node)
+{
+    Node<Key, Value>* parent = node->getParent();
+    if(node == parent->getLeft()) this->rotateRight(parent);
+    else this->rotateLeft(parent);
+    ++splayStats_.rotations;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the SplayTree class.
+  ----------------------------------------------
+*/
+
+#endif
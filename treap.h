@@ -0,0 +1,334 @@
+#ifndef TREAP_H
+#define TREAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A node of a treap: a Node plus its random priority.
+*/
+template <typename Key, typename Value>
+class TreapNode : public Node<Key, Value>
+{
+public:
+    TreapNode(const Key& key, const Value& value, TreapNode<Key, Value>* parent);
+    TreapNode(Key&& key, Value&& value, TreapNode<Key, Value>* parent);
+    ~TreapNode();
+
+    uint32_t getPriority() const;
+    void setPriority(uint32_t priority);
+
+    // Hide the Node getters, as AVLNode does; see the Node class in bst.h.
+    TreapNode<Key, Value>* getParent() const;
+    TreapNode<Key, Value>* getLeft() const;
+    TreapNode<Key, Value>* getRight() const;
+
+protected:
+    uint32_t priority_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the TreapNode class.
+  ------------------------------------------------
+*/
+
+/**
+* An explicit constructor; the tree sets the priority.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>::TreapNode(const Key& key, const Value& value, TreapNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), priority_(0)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>::TreapNode(Key&& key, Value&& value, TreapNode<Key, Value>* parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), priority_(0)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>::~TreapNode()
+{
+
+}
+
+/**
+* A getter for the priority of a TreapNode.
+*/
+template<class Key, class Value>
+uint32_t TreapNode<Key, Value>::getPriority() const
+{
+    return priority_;
+}
+
+/**
+* A setter for the priority of a TreapNode.
+*/
+template<class Key, class Value>
+void TreapNode<Key, Value>::setPriority(uint32_t priority)
+{
+    priority_ = priority;
+}
+
+/**
+* A getter for the parent that hides Node::getParent.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>* TreapNode<Key, Value>::getParent() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>* TreapNode<Key, Value>::getLeft() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+TreapNode<Key, Value>* TreapNode<Key, Value>::getRight() const
+{
+    return static_cast<TreapNode<Key, Value>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the TreapNode class.
+  ----------------------------------------------
+*/
+
+/**
+* A treap: a search tree by key that is also a heap by a random priority
+* drawn for each node, so its shape is that of a tree built by inserting
+* the keys in random order, O(log n) deep with high probability whatever
+* order they really came in. It keeps no balance data to update on the
+* way up; an update makes two rotations on average, and a removal rotates
+* the node down to a leaf instead of swapping it with its predecessor.
+* Priorities come from a generator with a fixed seed, so runs repeat.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class Treap : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    Treap();
+    explicit Treap(const Compare& comp);
+    template<typename InputIterator>
+    Treap(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual ~Treap();
+    bool isValid() const;
+
+protected:
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* buildBalanced(std::vector<std::pair<Key, Value> >& items,
+        std::size_t lo, std::size_t hi, Node<Key, Value>* parent);
+
+    uint32_t nextPriority();
+    static bool checkHeap(const TreapNode<Key, Value>* node);
+
+protected:
+    uint64_t seed_;     // xorshift state
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the Treap class.
+  --------------------------------------------
+*/
+
+/**
+* Default constructor; sizes the node pool for TreapNodes.
+*/
+template<class Key, class Value, class Compare>
+Treap<Key, Value, Compare>::Treap() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreapNode<Key, Value>), Compare()),
+    seed_(UINT64_C(0x9E3779B97F4A7C15))
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+Treap<Key, Value, Compare>::Treap(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreapNode<Key, Value>), comp),
+    seed_(UINT64_C(0x9E3779B97F4A7C15))
+{
+
+}
+
+/**
+* Range constructor; see BinarySearchTree::bulkLoad.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+Treap<Key, Value, Compare>::Treap(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreapNode<Key, Value>), comp),
+    seed_(UINT64_C(0x9E3779B97F4A7C15))
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Destructor; clears here so that destroyNode still runs ~TreapNode.
+*/
+template<class Key, class Value, class Compare>
+Treap<Key, Value, Compare>::~Treap()
+{
+    this->clear();
+}
+
+/**
+* Returns true if no node has a higher priority than its parent.
+*/
+template<class Key, class Value, class Compare>
+bool Treap<Key, Value, Compare>::isValid() const
+{
+    return checkHeap(static_cast<TreapNode<Key, Value>*>(this->root_));
+}
+
+/**
+* Destroys a TreapNode and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare>
+void Treap<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<TreapNode<Key, Value>*>(node)->~TreapNode();
+    this->pool_->deallocate(node);
+}
+
+/**
+* Creates a TreapNode with a fresh priority for the inserts of the base
+* class.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* Treap<Key, Value, Compare>::makeNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    TreapNode<Key, Value>* node =
+        this->createNode(std::move(key), std::move(value), static_cast<TreapNode<Key, Value>*>(parent));
+    node->setPriority(nextPriority());
+    return node;
+}
+
+/**
+* Hangs a new leaf below parent, then rotates it up past every ancestor
+* with a lower priority.
+*/
+template<class Key, class Value, class Compare>
+void Treap<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(node, parent, goLeft);
+    TreapNode<Key, Value>* child = static_cast<TreapNode<Key, Value>*>(node);
+    TreapNode<Key, Value>* above = child->getParent();
+    while(above != nullptr && above->getPriority() < child->getPriority()) {
+        if(child == above->getLeft()) this->rotateRight(above);
+        else this->rotateLeft(above);
+        above = child->getParent();
+    }
+}
+
+/**
+* Rotates the node down, each time lifting whichever child has the
+* higher priority, until it has at most one child, then unlinks it.
+*/
+template<class Key, class Value, class Compare>
+void Treap<Key, Value, Compare>::removeNode(Node<Key, Value>* removed)
+{
+    TreapNode<Key, Value>* node = static_cast<TreapNode<Key, Value>*>(removed);
+    while(node->getLeft() != nullptr && node->getRight() != nullptr) {
+        if(node->getLeft()->getPriority() > node->getRight()->getPriority()) this->rotateRight(node);
+        else this->rotateLeft(node);
+    }
+    BinarySearchTree<Key, Value, Compare>::removeNode(node);
+}
+
+/**
+* Builds a balanced subtree of TreapNodes from items[lo, hi). The
+* outermost call then hands out a fresh set of priorities, highest
+* first, in breadth-first order, which makes the shape a valid heap.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* Treap<Key, Value, Compare>::buildBalanced(std::vector<std::pair<Key, Value> >& items,
+    std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if(lo >= hi) return nullptr;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    TreapNode<Key, Value>* node = static_cast<TreapNode<Key, Value>*>(
+        makeNode(std::move(items[mid].first), std::move(items[mid].second), parent));
+    node->setLeft(buildBalanced(items, lo, mid, node));
+    node->setRight(buildBalanced(items, mid + 1, hi, node));
+
+    if(parent == nullptr) {
+        std::vector<uint32_t> priorities(hi - lo);
+        for(std::size_t i = 0; i < priorities.size(); ++i) priorities[i] = nextPriority();
+        std::sort(priorities.begin(), priorities.end(), std::greater<uint32_t>());
+
+        std::vector<TreapNode<Key, Value>*> level(1, node);
+        for(std::size_t head = 0; head < level.size(); ++head) {
+            TreapNode<Key, Value>* current = level[head];
+            current->setPriority(priorities[head]);
+            if(current->getLeft() != nullptr) level.push_back(current->getLeft());
+            if(current->getRight() != nullptr) level.push_back(current->getRight());
+        }
+    }
+    return node;
+}
+
+/**
+* Draws the next priority (xorshift64*).
+*/
+template<class Key, class Value, class Compare>
+uint32_t Treap<Key, Value, Compare>::nextPriority()
+{
+    seed_ ^= seed_ >> 12;
+    seed_ ^= seed_ << 25;
+    seed_ ^= seed_ >> 27;
+    return static_cast<uint32_t>((seed_ * UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+}
+
+/**
+* Returns true if the heap order holds below node.
+*/
+template<class Key, class Value, class Compare>
+bool Treap<Key, Value, Compare>::checkHeap(const TreapNode<Key, Value>* node)
+{
+    if(node == nullptr) return true;
+    const TreapNode<Key, Value>* left = node->getLeft();
+    const TreapNode<Key, Value>* right = node->getRight();
+    if(left != nullptr && left->getPriority() > node->getPriority()) return false;
+    if(right != nullptr && right->getPriority() > node->getPriority()) return false;
+    return checkHeap(left) && checkHeap(right);
+}
+
+/*
+  ------------------------------------------
+  End implementations for the Treap class.
+  ------------------------------------------
+*/
+
+#endif
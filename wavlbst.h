@@ -0,0 +1,455 @@
+#ifndef WAVLBST_H
+#define WAVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A node of a WAVL tree: a Node plus its rank.
+*/
+template <typename Key, typename Value>
+class WAVLNode : public Node<Key, Value>
+{
+public:
+    WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent);
+    WAVLNode(Key&& key, Value&& value, WAVLNode<Key, Value>* parent);
+    ~WAVLNode();
+
+    int8_t getRank() const;
+    void setRank(int8_t rank);
+    void updateRank(int8_t diff);
+
+    // Hide the Node getters, as AVLNode does; see the Node class in bst.h.
+    WAVLNode<Key, Value>* getParent() const;
+    WAVLNode<Key, Value>* getLeft() const;
+    WAVLNode<Key, Value>* getRight() const;
+
+protected:
+    int8_t rank_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the WAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* Constructor for a leaf, whose rank is 0.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>::WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), rank_(0)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>::WAVLNode(Key&& key, Value&& value, WAVLNode<Key, Value>* parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), rank_(0)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>::~WAVLNode()
+{
+
+}
+
+/**
+* A getter for the rank of a WAVLNode.
+*/
+template<class Key, class Value>
+int8_t WAVLNode<Key, Value>::getRank() const
+{
+    return rank_;
+}
+
+/**
+* A setter for the rank of a WAVLNode.
+*/
+template<class Key, class Value>
+void WAVLNode<Key, Value>::setRank(int8_t rank)
+{
+    rank_ = rank;
+}
+
+/**
+* Adds diff to the rank of a WAVLNode.
+*/
+template<class Key, class Value>
+void WAVLNode<Key, Value>::updateRank(int8_t diff)
+{
+    rank_ += diff;
+}
+
+/**
+* A getter for the parent that hides Node::getParent.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the WAVLNode class.
+  ---------------------------------------------
+*/
+
+/**
+* A weak AVL (WAVL) tree, after Haeupler, Sen and Tarjan, "Rank-Balanced
+* Trees". Every node has a rank, an empty slot has rank -1, and a child
+* ranks 1 or 2 below its parent; leaves have rank 0. Built by inserts
+* alone it is an AVL tree. Unlike an AVL tree, a removal never needs more
+* than two rotations: instead of rotating at every level it demotes, and
+* rotations over any sequence of updates are O(1) amortized.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class WAVLTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    WAVLTree();
+    explicit WAVLTree(const Compare& comp);
+    template<typename InputIterator>
+    WAVLTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual ~WAVLTree();
+    bool isValid() const;
+
+protected:
+    virtual void nodeSwap(WAVLNode<Key, Value>* n1, WAVLNode<Key, Value>* n2);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* makeNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* buildBalanced(std::vector<std::pair<Key, Value> >& items,
+        std::size_t lo, std::size_t hi, Node<Key, Value>* parent);
+
+    static int rankOf(const WAVLNode<Key, Value>* node);
+    void insertFix(WAVLNode<Key, Value>* node);
+    void removeFix(WAVLNode<Key, Value>* parent, bool leftShort);
+    static int checkRanks(const WAVLNode<Key, Value>* node);
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the WAVLTree class.
+  -----------------------------------------------
+*/
+
+/**
+* Default constructor; sizes the node pool for WAVLNodes.
+*/
+template<class Key, class Value, class Compare>
+WAVLTree<Key, Value, Compare>::WAVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(WAVLNode<Key, Value>), Compare())
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<class Key, class Value, class Compare>
+WAVLTree<Key, Value, Compare>::WAVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(WAVLNode<Key, Value>), comp)
+{
+
+}
+
+/**
+* Range constructor; see BinarySearchTree::bulkLoad.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIterator>
+WAVLTree<Key, Value, Compare>::WAVLTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(WAVLNode<Key, Value>), comp)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Destructor; clears here so that destroyNode still runs ~WAVLNode.
+*/
+template<class Key, class Value, class Compare>
+WAVLTree<Key, Value, Compare>::~WAVLTree()
+{
+    this->clear();
+}
+
+/**
+* Returns true if every rank difference is 1 or 2 and every leaf has
+* rank 0.
+*/
+template<class Key, class Value, class Compare>
+bool WAVLTree<Key, Value, Compare>::isValid() const
+{
+    return checkRanks(static_cast<WAVLNode<Key, Value>*>(this->root_)) >= -1;
+}
+
+/**
+* Trades the places of two nodes, and their ranks with them, since a
+* rank belongs to the position.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::nodeSwap(WAVLNode<Key, Value>* n1, WAVLNode<Key, Value>* n2)
+{
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    int8_t rank = n1->getRank();
+    n1->setRank(n2->getRank());
+    n2->setRank(rank);
+}
+
+/**
+* Destroys a WAVLNode and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<WAVLNode<Key, Value>*>(node)->~WAVLNode();
+    this->pool_->deallocate(node);
+}
+
+/**
+* Creates a WAVLNode for the inserts of the base class.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* WAVLTree<Key, Value, Compare>::makeNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    return this->createNode(std::move(key), std::move(value), static_cast<WAVLNode<Key, Value>*>(parent));
+}
+
+/**
+* Hangs a new leaf below parent and rebalances up from it.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(node, parent, goLeft);
+    insertFix(static_cast<WAVLNode<Key, Value>*>(node));
+}
+
+/**
+* Unlinks a node. As in the other trees, a node with two children first
+* swaps places with its predecessor. Its child, or the empty slot, then
+* ranks one or two lower relative to the parent than before, which
+* removeFix repairs.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::removeNode(Node<Key, Value>* removed)
+{
+    WAVLNode<Key, Value>* node = static_cast<WAVLNode<Key, Value>*>(removed);
+    if(node->getLeft() != nullptr && node->getRight() != nullptr) {
+        WAVLNode<Key, Value>* pred = static_cast<WAVLNode<Key, Value>*>(this->predecessor(node));
+        nodeSwap(pred, node);
+        if(this->threaded_) node->setSuccessorThread(pred);
+    }
+
+    WAVLNode<Key, Value>* parent = node->getParent();
+    WAVLNode<Key, Value>* child = node->getLeft() ? node->getLeft() : node->getRight();
+    bool left = parent != nullptr && parent->getLeft() == node;
+    if(child != nullptr) child->setParent(parent);
+    if(parent == nullptr) {
+        this->root_ = child;
+    }
+    else if(left) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+
+    this->threadPast(node);
+    this->uncache(node);
+    destroyNode(node);
+    if(parent != nullptr) removeFix(parent, left);
+}
+
+/**
+* Builds a balanced subtree of WAVLNodes from items[lo, hi). A node's
+* rank is its height less one, which follows from the size of its range.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* WAVLTree<Key, Value, Compare>::buildBalanced(std::vector<std::pair<Key, Value> >& items,
+    std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if(lo >= hi) return nullptr;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    WAVLNode<Key, Value>* node = static_cast<WAVLNode<Key, Value>*>(
+        makeNode(std::move(items[mid].first), std::move(items[mid].second), parent));
+    node->setLeft(buildBalanced(items, lo, mid, node));
+    node->setRight(buildBalanced(items, mid + 1, hi, node));
+    int8_t rank = -1;
+    for(std::size_t size = hi - lo; size != 0; size >>= 1) ++rank;
+    node->setRank(rank);
+    return node;
+}
+
+/**
+* Returns the rank of a node, or -1 for an empty slot.
+*/
+template<class Key, class Value, class Compare>
+int WAVLTree<Key, Value, Compare>::rankOf(const WAVLNode<Key, Value>* node)
+{
+    return node == nullptr ? -1 : node->getRank();
+}
+
+/**
+* Restores the ranks after node was linked in as a leaf. While node ranks
+* the same as its parent: if the parent's other child is one below,
+* promote the parent and go up; otherwise one single or double rotation
+* ends it, as in an AVL tree.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::insertFix(WAVLNode<Key, Value>* node)
+{
+    WAVLNode<Key, Value>* parent = node->getParent();
+    while(parent != nullptr && parent->getRank() == node->getRank()) {
+        bool left = node == parent->getLeft();
+        WAVLNode<Key, Value>* sibling = left ? parent->getRight() : parent->getLeft();
+        if(parent->getRank() - rankOf(sibling) == 1) {
+            parent->updateRank(1);
+            node = parent;
+            parent = node->getParent();
+            continue;
+        }
+
+        // The sibling is two below: rotate node's taller side up
+        WAVLNode<Key, Value>* inner = left ? node->getRight() : node->getLeft();
+        if(node->getRank() - rankOf(inner) == 2) {
+            if(left) this->rotateRight(parent);
+            else this->rotateLeft(parent);
+            parent->updateRank(-1);
+        }
+        else {
+            if(left) {
+                this->rotateLeft(node);
+                this->rotateRight(parent);
+            }
+            else {
+                this->rotateRight(node);
+                this->rotateLeft(parent);
+            }
+            inner->updateRank(1);
+            node->updateRank(-1);
+            parent->updateRank(-1);
+        }
+        return;
+    }
+}
+
+/**
+* Restores the ranks below parent after its left (leftShort) or right
+* child ranks one lower than before. A leaf left with rank 1 is demoted.
+* Then, while a child ranks three below its parent: a parent whose other
+* child is two below, or is one below with both its own children two
+* below, is demoted (with that child, in the second case) and the climb
+* goes on; otherwise one single or double rotation ends it.
+*/
+template<class Key, class Value, class Compare>
+void WAVLTree<Key, Value, Compare>::removeFix(WAVLNode<Key, Value>* parent, bool leftShort)
+{
+    WAVLNode<Key, Value>* node = leftShort ? parent->getLeft() : parent->getRight();
+    if(parent->getLeft() == nullptr && parent->getRight() == nullptr && parent->getRank() == 1) {
+        // A leaf must have rank 0; demoting it lowers it under its own parent
+        parent->setRank(0);
+        node = parent;
+        parent = node->getParent();
+        if(parent != nullptr) leftShort = node == parent->getLeft();
+    }
+
+    while(parent != nullptr && parent->getRank() - rankOf(node) == 3) {
+        WAVLNode<Key, Value>* sibling = leftShort ? parent->getRight() : parent->getLeft();
+        if(parent->getRank() - rankOf(sibling) == 2) {
+            parent->updateRank(-1);
+        }
+        else if(sibling->getRank() - rankOf(sibling->getLeft()) == 2 &&
+                sibling->getRank() - rankOf(sibling->getRight()) == 2) {
+            parent->updateRank(-1);
+            sibling->updateRank(-1);
+        }
+        else {
+            WAVLNode<Key, Value>* inner = leftShort ? sibling->getLeft() : sibling->getRight();
+            WAVLNode<Key, Value>* outer = leftShort ? sibling->getRight() : sibling->getLeft();
+            if(sibling->getRank() - rankOf(outer) == 1) {
+                if(leftShort) this->rotateLeft(parent);
+                else this->rotateRight(parent);
+                sibling->updateRank(1);
+                parent->updateRank(-1);
+                if(parent->getLeft() == nullptr && parent->getRight() == nullptr) parent->setRank(0);
+            }
+            else {
+                if(leftShort) {
+                    this->rotateRight(sibling);
+                    this->rotateLeft(parent);
+                }
+                else {
+                    this->rotateLeft(sibling);
+                    this->rotateRight(parent);
+                }
+                inner->updateRank(2);
+                sibling->updateRank(-1);
+                parent->updateRank(-2);
+            }
+            return;
+        }
+        node = parent;
+        parent = node->getParent();
+        if(parent != nullptr) leftShort = node == parent->getLeft();
+    }
+}
+
+/**
+* Returns the rank of node if the rank rules hold below it, or -2 if not.
+*/
+template<class Key, class Value, class Compare>
+int WAVLTree<Key, Value, Compare>::checkRanks(const WAVLNode<Key, Value>* node)
+{
+    if(node == nullptr) return -1;
+    int left = checkRanks(node->getLeft());
+    int right = checkRanks(node->getRight());
+    if(left < -1 || right < -1) return -2;
+    int rank = node->getRank();
+    if(rank - left < 1 || rank - left > 2 || rank - right < 1 || rank - right > 2) return -2;
+    if(node->getLeft() == nullptr && node->getRight() == nullptr && rank != 0) return -2;
+    return rank;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the WAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif